@@ -0,0 +1,288 @@
+#include "simulation.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs fixed scenarios for a fixed number of ticks at several world sizes
+// and writes the timings as JSON, so throughput can be compared between
+// builds. Every scenario is seeded, so two runs simulate the same world.
+//
+//   Benchmark [--ticks N] [--threads N] [--output file.json] [--trace trace.json]
+//             [--world file.snapshot]
+//   Benchmark --check-upload
+//
+// With --world only the saved world is run, at its own size. --check-upload
+// times nothing, it checks partial texture uploads against what the GPU
+// holds and fails on the first difference.
+
+namespace
+{
+	constexpr uint64_t seed = 12345;
+
+	struct Scenario
+	{
+		const char* name;
+		std::function<void(Simulation&)> setup;
+	};
+
+	struct WorldSize
+	{
+		int width;
+		int height;
+	};
+
+	struct Result
+	{
+		std::string scenario;
+		WorldSize size;
+		int ticks = 0;
+		double seconds = 0.0;
+		double cellsPerSecond = 0.0;
+		double nsPerActiveParticle = 0.0;
+		double tickP50Ms = 0.0;
+		double tickP99Ms = 0.0;
+		long long processedCells = 0;
+	};
+
+	//*** Sand avalanche: a block of sand collapses down a stone slope
+	void SandAvalanche(Simulation& simulation)
+	{
+		int w = simulation.GetWidth();
+		int h = simulation.GetHeight();
+		for (int x = 0; x < w; ++x)
+		{
+			int top = h - 1 - (w - x) * h / (3 * w);
+			simulation.FillRect(x, top, 1, h - top, MaterialId::Stone);
+		}
+		simulation.FillRect(0, 0, w / 2, h / 2, MaterialId::Sand);
+	}
+
+	//*** Water pool: half the world is water dropped from the top, left to level out
+	void WaterPool(Simulation& simulation)
+	{
+		int w = simulation.GetWidth();
+		int h = simulation.GetHeight();
+		simulation.FillRect(0, 0, w, h / 2, MaterialId::Water, 0.9f);
+	}
+
+	//*** Mass water pool: the same pool with water as mass
+	void MassWaterPool(Simulation& simulation)
+	{
+		simulation.SetWaterModel(WaterModel::Mass);
+		WaterPool(simulation);
+	}
+
+	//*** Sand into water: a stream of sand pouring into a full basin
+	void SandIntoWater(Simulation& simulation)
+	{
+		int w = simulation.GetWidth();
+		int h = simulation.GetHeight();
+		simulation.FillRect(0, h / 2, w, h - h / 2, MaterialId::Water);
+		simulation.AddEmitter({ w / 2, 8, std::max(w / 32, 1), MaterialId::Sand, std::max(w / 8, 1) });
+	}
+
+	//*** Lava into water: a stream of lava pouring into a full basin, boiling
+	// it and cooling into stone
+	void LavaIntoWater(Simulation& simulation)
+	{
+		int w = simulation.GetWidth();
+		int h = simulation.GetHeight();
+		simulation.FillRect(0, h / 2, w, h - h / 2, MaterialId::Water);
+		simulation.AddEmitter({ w / 2, 8, std::max(w / 32, 1), MaterialId::Lava, std::max(w / 8, 1) });
+	}
+
+	//*** Smoke plume: smoke sprayed along the floor of a room, rising to the
+	// ceiling and spreading under it as it fades
+	void SmokePlume(Simulation& simulation)
+	{
+		int w = simulation.GetWidth();
+		int h = simulation.GetHeight();
+		simulation.FillRect(0, 0, w, 4, MaterialId::Stone);
+		for (int i = 1; i < 8; ++i)
+			simulation.AddEmitter({ i * w / 8, h - 8, std::max(w / 64, 1), MaterialId::Smoke, std::max(w / 16, 1) });
+	}
+
+	//*** Mostly static: solid ground under a settled layer of sand, with one
+	// small tap. Measures what sleeping chunks still cost.
+	void MostlyStatic(Simulation& simulation)
+	{
+		int w = simulation.GetWidth();
+		int h = simulation.GetHeight();
+		simulation.FillRect(0, h / 4, w, h - h / 4, MaterialId::Stone);
+		simulation.FillRect(0, h / 4 - 8, w, 8, MaterialId::Sand);
+		simulation.AddEmitter({ w / 8, 4, 2, MaterialId::Water, 2 });
+	}
+
+	double Percentile(std::vector<double> values, double p)
+	{
+		if (values.empty())
+			return 0.0;
+		std::sort(values.begin(), values.end());
+		size_t index = size_t(p * double(values.size() - 1) + 0.5);
+		return values[index];
+	}
+
+	Result Run(const Scenario& scenario, WorldSize size, int ticks, int threads)
+	{
+		Simulation simulation;
+		simulation.SetSeed(seed);
+		simulation.InitSimulation(size.width, size.height);
+		simulation.SetThreadCount(threads);
+		scenario.setup(simulation);
+
+		using Clock = std::chrono::steady_clock;
+		std::vector<double> tickMs;
+		tickMs.reserve(ticks);
+
+		Result result;
+		result.scenario = scenario.name;
+		result.size = { simulation.GetWidth(), simulation.GetHeight() };
+		result.ticks = ticks;
+
+		for (int i = 0; i < ticks; ++i)
+		{
+			Clock::time_point start = Clock::now();
+			simulation.ProcessSimulation();
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			tickMs.push_back(ms);
+			result.seconds += ms / 1000.0;
+			result.processedCells += simulation.GetTickStats().processedCells;
+		}
+
+		double cells = double(result.size.width) * result.size.height * ticks;
+		result.cellsPerSecond = result.seconds > 0.0 ? cells / result.seconds : 0.0;
+		result.nsPerActiveParticle = result.processedCells > 0 ? result.seconds * 1e9 / double(result.processedCells) : 0.0;
+		result.tickP50Ms = Percentile(tickMs, 0.50);
+		result.tickP99Ms = Percentile(tickMs, 0.99);
+		return result;
+	}
+
+	void WriteJson(FILE* file, const std::vector<Result>& results, int ticks, int threads)
+	{
+		fprintf(file, "{\n");
+		fprintf(file, "  \"seed\": %llu,\n", (unsigned long long)seed);
+		fprintf(file, "  \"ticks\": %d,\n", ticks);
+		fprintf(file, "  \"threads\": %d,\n", threads);
+		fprintf(file, "  \"results\": [\n");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const Result& r = results[i];
+			fprintf(file, "    { \"scenario\": \"%s\", \"width\": %d, \"height\": %d, \"ticks\": %d, "
+				"\"seconds\": %.6f, \"cellsPerSecond\": %.0f, \"nsPerActiveParticle\": %.3f, "
+				"\"tickP50Ms\": %.4f, \"tickP99Ms\": %.4f, \"processedCells\": %lld }%s\n",
+				r.scenario.c_str(), r.size.width, r.size.height, r.ticks,
+				r.seconds, r.cellsPerSecond, r.nsPerActiveParticle,
+				r.tickP50Ms, r.tickP99Ms, r.processedCells, i + 1 < results.size() ? "," : "");
+		}
+		fprintf(file, "  ]\n");
+		fprintf(file, "}\n");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int ticks = 300;
+	int threads = std::max(int(std::thread::hardware_concurrency()), 1);
+	const char* output = nullptr;
+	const char* traceFile = nullptr;
+	const char* worldFile = nullptr;
+
+	if (argc > 1 && strcmp(argv[1], "--check-upload") == 0)
+	{
+		std::string error;
+		if (olc::CheckRegionUploads(error) != olc::OK)
+		{
+			fprintf(stderr, "Region uploads: %s\n", error.c_str());
+			return 1;
+		}
+		fprintf(stderr, "Region uploads match the texture\n");
+		return 0;
+	}
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--ticks") == 0)
+			ticks = std::max(atoi(argv[i + 1]), 1);
+		else if (strcmp(argv[i], "--threads") == 0)
+			threads = std::max(atoi(argv[i + 1]), 1);
+		else if (strcmp(argv[i], "--output") == 0)
+			output = argv[i + 1];
+		else if (strcmp(argv[i], "--trace") == 0)
+			traceFile = argv[i + 1];
+		else if (strcmp(argv[i], "--world") == 0)
+			worldFile = argv[i + 1];
+	}
+
+	// Keeps the first events only, which is enough to see how chunks
+	// spread over the workers
+	if (traceFile)
+	{
+		olc::Trace::SetThreadName("Main");
+		olc::Trace::Start();
+	}
+
+	const Scenario scenarios[] =
+	{
+		{ "sandAvalanche", SandAvalanche },
+		{ "waterPool", WaterPool },
+		{ "massWaterPool", MassWaterPool },
+		{ "sandIntoWater", SandIntoWater },
+		{ "lavaIntoWater", LavaIntoWater },
+		{ "smokePlume", SmokePlume },
+		{ "mostlyStatic", MostlyStatic },
+	};
+	const WorldSize sizes[] = { { 256, 256 }, { 512, 512 }, { 1024, 1024 } };
+
+	std::vector<Result> results;
+	auto Report = [&](const Scenario& scenario, WorldSize size)
+	{
+		results.push_back(Run(scenario, size, ticks, threads));
+		const Result& r = results.back();
+		fprintf(stderr, "%-14s %4dx%-4d  %8.2f Mcells/s  %7.2f ns/particle  p50 %7.3f ms  p99 %7.3f ms\n",
+			r.scenario.c_str(), r.size.width, r.size.height, r.cellsPerSecond / 1e6,
+			r.nsPerActiveParticle, r.tickP50Ms, r.tickP99Ms);
+	};
+
+	if (worldFile)
+	{
+		bool loaded = false;
+		Scenario snapshot = { "snapshot", [&](Simulation& simulation) { loaded = simulation.LoadSnapshot(worldFile); } };
+		Report(snapshot, { 1, 1 });
+		if (!loaded)
+		{
+			fprintf(stderr, "Could not load %s\n", worldFile);
+			return 1;
+		}
+	}
+	else
+	{
+		for (const WorldSize& size : sizes)
+			for (const Scenario& scenario : scenarios)
+				Report(scenario, size);
+	}
+
+	if (traceFile)
+	{
+		olc::Trace::Stop();
+		olc::Trace::Save(traceFile);
+	}
+
+	FILE* file = output ? fopen(output, "w") : stdout;
+	if (file == nullptr)
+	{
+		fprintf(stderr, "Could not open %s\n", output);
+		return 1;
+	}
+	WriteJson(file, results, ticks, threads);
+	if (file != stdout)
+		fclose(file);
+
+	return 0;
+}
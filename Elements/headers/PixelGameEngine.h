@@ -168,6 +168,8 @@
 #include <list>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <memory>
 #include <fstream>
 #include <map>
 #include <functional>
@@ -216,6 +218,9 @@ namespace _gfs = std::filesystem;
 #define OLC_GFX_OPENGL10
 #endif
 
+// Define OLC_PGE_HEADLESS to always run without a window, using the CPU
+// renderer, whatever is passed to Construct()
+
 // O------------------------------------------------------------------------------O
 // | olcPixelGameEngine INTERFACE DECLARATION                                     |
 // O------------------------------------------------------------------------------O
@@ -392,6 +397,171 @@ namespace olc
 
 
 
+	// O------------------------------------------------------------------------------O
+	// | olc::DirtyRegion - Areas of an image changed since the last GPU upload       |
+	// O------------------------------------------------------------------------------O
+	struct DirtyRegion
+	{
+		// Half open rectangle [x0, x1) x [y0, y1)
+		struct Rect { int32_t x0 = 0, y0 = 0, x1 = 0, y1 = 0; };
+
+		// Touching rectangles are merged, and beyond this many the region
+		// collapses into its bounding box
+		static constexpr size_t nMaxRects = 32;
+
+		void Add(int32_t x, int32_t y, int32_t w, int32_t h);
+		void Add(const DirtyRegion& other);
+		// Keeps only the parts inside [0, w) x [0, h)
+		void Clip(int32_t w, int32_t h);
+		void Clear();
+		bool Empty() const;
+
+		std::vector<Rect> vRects;
+	};
+
+	// O------------------------------------------------------------------------------O
+	// | olc::Profiler - Recent durations of named phases of a frame                  |
+	// O------------------------------------------------------------------------------O
+	class Profiler
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		static constexpr size_t nMaxPhases = 32;
+		// Samples kept per phase, older ones are overwritten
+		static constexpr size_t nHistory = 256;
+
+		struct Stats
+		{
+			float fAverageMs = 0.0f;
+			float fP99Ms = 0.0f;
+			uint32_t nSamples = 0;
+		};
+
+		// Register every phase before any thread records into it. Returns
+		// the phase id, or the existing one if the name is taken.
+		uint32_t AddPhase(const std::string& sName);
+		uint32_t GetPhaseCount() const;
+		const std::string& GetPhaseName(uint32_t nPhase) const;
+
+		// Lock free, any number of threads may record at once
+		void Record(uint32_t nPhase, float fMs);
+		void Record(uint32_t nPhase, Clock::time_point tpStart);
+		Stats GetStats(uint32_t nPhase) const;
+
+	private:
+		struct Ring
+		{
+			std::string sName;
+			std::atomic<uint32_t> nNext{ 0 };
+			std::array<std::atomic<float>, nHistory> fSamples{};
+		};
+
+		std::array<Ring, nMaxPhases> vPhases;
+		std::atomic<uint32_t> nPhaseCount{ 0 };
+	};
+
+	// Records the time from construction to destruction
+	struct ProfileScope
+	{
+		ProfileScope(Profiler& p, uint32_t phase) : profiler(p), nPhase(phase), tpStart(Profiler::Clock::now()) {}
+		~ProfileScope() { profiler.Record(nPhase, tpStart); }
+
+		Profiler& profiler;
+		uint32_t nPhase;
+		Profiler::Clock::time_point tpStart;
+	};
+
+	// O------------------------------------------------------------------------------O
+	// | olc::Trace - Timeline of events on every thread, saved as Chrome trace JSON  |
+	// O------------------------------------------------------------------------------O
+	// Open a saved trace in ui.perfetto.dev or chrome://tracing. While nothing
+	// is being recorded a TraceScope costs a single relaxed load.
+	class Trace
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		// Starts recording at most nMaxEvents events, later ones are dropped
+		static void Start(size_t nMaxEvents = 1 << 18);
+		static void Stop();
+		static bool IsRecording() { return bRecording.load(std::memory_order_relaxed); }
+		// Writes the recording, call once every traced thread is done with it
+		static olc::rcode Save(const std::string& sFile);
+		// Names the calling thread in saved traces
+		static void SetThreadName(const std::string& sName);
+		// sName is stored as a pointer, so it must be a string literal
+		static void Record(const char* sName, int32_t nArg, Clock::time_point tpStart, Clock::time_point tpEnd);
+
+	private:
+		struct Event
+		{
+			const char* sName = nullptr;
+			int32_t nArg = -1;
+			uint32_t nThread = 0;
+			int64_t nStartNs = 0;
+			int64_t nDurationNs = 0;
+			// Set last, so Save() never reads an event still being written
+			std::atomic<bool> bReady{ false };
+		};
+
+		static uint32_t ThreadId();
+
+		static std::atomic<bool> bRecording;
+		static std::unique_ptr<Event[]> pEvents;
+		static size_t nCapacity;
+		static std::atomic<size_t> nNextEvent;
+		static Clock::time_point tpOrigin;
+		static std::mutex muxThreadNames;
+		static std::map<uint32_t, std::string> mapThreadNames;
+	};
+
+	// Records one event from construction to destruction, with an optional
+	// number such as a chunk index shown alongside it
+	struct TraceScope
+	{
+		TraceScope(const char* name, int32_t arg = -1) : sName(name), nArg(arg)
+		{
+			if (Trace::IsRecording()) tpStart = Trace::Clock::now();
+		}
+
+		~TraceScope()
+		{
+			if (tpStart != Trace::Clock::time_point()) Trace::Record(sName, nArg, tpStart, Trace::Clock::now());
+		}
+
+		const char* sName;
+		int32_t nArg;
+		Trace::Clock::time_point tpStart;
+	};
+
+	// O------------------------------------------------------------------------------O
+	// | olc::InputRecording - The input of every frame, for replaying a session      |
+	// O------------------------------------------------------------------------------O
+	// Holds exactly what olc_CoreUpdate reads from the platform each frame. Fed
+	// back in place of the hardware, it reproduces a session frame for frame.
+	class InputRecording
+	{
+	public:
+		struct Frame
+		{
+			int32_t nMouseX = 0;
+			int32_t nMouseY = 0;
+			int32_t nMouseWheel = 0;
+			float fElapsedTime = 0.0f;
+			// One bit per mouse button and per key, set while held
+			uint8_t nButtons = 0;
+			uint8_t pKeys[32]{ 0 };
+		};
+
+		// Anything the application needs to start the same way, such as a seed
+		uint64_t nSeed = 0;
+		std::vector<Frame> vFrames;
+
+		olc::rcode Save(const std::string& sFile) const;
+		olc::rcode Load(const std::string& sFile);
+	};
+
 	// O------------------------------------------------------------------------------O
 	// | olc::Sprite - An image represented by a 2D array of olc::Pixel               |
 	// O------------------------------------------------------------------------------O
@@ -401,6 +571,9 @@ namespace olc
 		Sprite();
 		Sprite(const std::string& sImageFile, olc::ResourcePack* pack = nullptr);
 		Sprite(int32_t w, int32_t h);
+		// Wraps pixels owned elsewhere. Nothing is copied and nothing is freed,
+		// so the memory must outlive the sprite.
+		Sprite(int32_t w, int32_t h, Pixel* pData);
 		~Sprite();
 
 	public:
@@ -423,8 +596,20 @@ namespace olc
 		Pixel Sample(float x, float y) const;
 		Pixel SampleBL(float u, float v) const;
 		Pixel* GetData();
+		// Points the sprite at width * height pixels owned elsewhere, or back
+		// at memory of its own when pData is nullptr
+		void SetExternalData(Pixel* pData);
+		bool OwnsData() const;
+		// Records pixels changed other than through the engine's draw calls,
+		// e.g. with SetPixel or through GetData(), so only they are uploaded
+		// to textures made from this sprite
+		void MarkDirty(int32_t x, int32_t y, int32_t w, int32_t h);
 		Pixel* pColData = nullptr;
 		Mode modeSample = Mode::NORMAL;
+		DirtyRegion dirty;
+
+	private:
+		bool bOwnsData = true;
 	};
 
 	// O------------------------------------------------------------------------------O
@@ -435,12 +620,16 @@ namespace olc
 	public:
 		Decal(olc::Sprite* spr);
 		virtual ~Decal();
+		// Uploads the whole sprite
 		void Update();
+		// Uploads only what changed in the sprite, plus anything in dirty
+		void UpdateDirty();
 
 	public: // But dont touch
 		int32_t id = -1;
 		olc::Sprite* sprite = nullptr;
 		olc::vf2d vUVScale = { 1.0f, 1.0f };
+		DirtyRegion dirty;
 	};
 
 	// O------------------------------------------------------------------------------O
@@ -490,6 +679,8 @@ namespace olc
 		bool bUpdate = false;
 		olc::Sprite* pDrawTarget = nullptr;
 		uint32_t nResID = 0;
+		// Merged with the draw target's own dirty region on upload
+		DirtyRegion dirty;
 		std::vector<DecalInstance> vecDecalInstance;
 		olc::Pixel tint = olc::WHITE;
 		std::function<void()> funcHook = nullptr;
@@ -507,10 +698,13 @@ namespace olc
 		virtual void       DrawDecalQuad(const olc::DecalInstance& decal) = 0;
 		virtual uint32_t   CreateTexture(const uint32_t width, const uint32_t height) = 0;
 		virtual void       UpdateTexture(uint32_t id, olc::Sprite* spr) = 0;
+		virtual void       UpdateTextureRegion(uint32_t id, olc::Sprite* spr, const olc::DirtyRegion& region) = 0;
 		virtual uint32_t   DeleteTexture(const uint32_t id) = 0;
 		virtual void       ApplyTexture(uint32_t id) = 0;
 		virtual void       UpdateViewport(const olc::vi2d& pos, const olc::vi2d& size) = 0;
 		virtual void       ClearBuffer(olc::Pixel p, bool bDepth) = 0;
+		// Renderers that draw into memory return the last presented frame
+		virtual olc::Sprite* GetFrameBuffer() const { return nullptr; }
 		static olc::PixelGameEngine* ptrPGE;
 	};
 
@@ -533,6 +727,12 @@ namespace olc
 	static std::unique_ptr<Platform> platform;
 	static std::map<size_t, uint8_t> mapKeys;
 
+	// Draws into a sprite with the engine, uploads the changed regions through
+	// the OpenGL 1.0 renderer and compares the texture read back with the
+	// sprite. Runs on Mesa's software GL without a window, so only where Mesa's
+	// EGL is available. Call it before any engine exists.
+	olc::rcode CheckRegionUploads(std::string& sError);
+
 	// O------------------------------------------------------------------------------O
 	// | olc::PixelGameEngine - The main BASE class for your application              |
 	// O------------------------------------------------------------------------------O
@@ -542,8 +742,10 @@ namespace olc
 		PixelGameEngine();
 		virtual ~PixelGameEngine();
 	public:
+		// A headless engine opens no window and renders on the CPU into a
+		// framebuffer in memory, see GetFrameBuffer()
 		olc::rcode Construct(int32_t screen_w, int32_t screen_h, int32_t pixel_w, int32_t pixel_h,
-			bool full_screen = false, bool vsync = false);
+			bool full_screen = false, bool vsync = false, bool headless = false);
 		olc::rcode Start();
 
 	public: // User Override Interfaces
@@ -592,6 +794,24 @@ namespace olc
 		const float GetElapsedTime() const;
 		// Gets Actual Window size
 		const olc::vi2d& GetWindowSize() const;
+		// Ends the engine after this many frames, 0 runs until the user quits
+		void SetFrameLimit(uint32_t frames);
+		// Durations of each part of a frame, see olc_CoreUpdate. Applications
+		// may add phases of their own.
+		olc::Profiler& GetProfiler();
+		// The last presented frame at window size, or nullptr when the
+		// renderer draws straight to the screen
+		olc::Sprite* GetFrameBuffer() const;
+		// Records the input of every frame from the next one on, nSeed is
+		// saved with it for the application to read back on replay
+		void StartInputRecording(uint64_t nSeed);
+		// Stops recording and writes what was recorded
+		olc::rcode SaveInputRecording(const std::string& sFile);
+		// Replaces the hardware with a recording, the engine stops after its last frame
+		olc::rcode StartInputReplay(const std::string& sFile);
+		bool IsReplayingInput() const;
+		// The seed of the recording being made or replayed
+		uint64_t GetInputSeed() const;
 
 	public: // CONFIGURATION ROUTINES
 		// Layer targeting functions
@@ -603,6 +823,11 @@ namespace olc
 		void SetLayerScale(uint8_t layer, float x, float y);
 		void SetLayerTint(uint8_t layer, const olc::Pixel& tint);
 		void SetLayerCustomRenderFunction(uint8_t layer, std::function<void()> f);
+		// Displays ScreenWidth() * ScreenHeight() pixels owned elsewhere on a
+		// layer without copying them, nullptr gives the layer its own memory back.
+		// If the new pixels only differ from the old ones inside pChanged, only
+		// that region is uploaded instead of the whole layer.
+		void SetLayerExternalData(uint8_t layer, olc::Pixel* pData, const olc::DirtyRegion* pChanged = nullptr);
 
 		std::vector<LayerDesc>& GetLayers();
 		uint32_t CreateLayer();
@@ -726,6 +951,19 @@ namespace olc
 		std::vector<LayerDesc> vLayers;
 		uint8_t		nTargetLayer = 0;
 		uint32_t	nLastFPS = 0;
+		uint32_t	nFrameLimit = 0;
+		uint32_t	nFramesRun = 0;
+		olc::Profiler profiler;
+		uint32_t	nPhaseInput = 0;
+		uint32_t	nPhaseUserUpdate = 0;
+		uint32_t	nPhaseUpload = 0;
+		uint32_t	nPhaseLayers = 0;
+		uint32_t	nPhaseDecals = 0;
+		uint32_t	nPhasePresent = 0;
+		olc::InputRecording inputRecording;
+		bool		bRecordingInput = false;
+		bool		bReplayingInput = false;
+		size_t		nReplayFrame = 0;
 		std::function<olc::Pixel(const int x, const int y, const olc::Pixel&, const olc::Pixel&)> funcPixelMode;
 		std::chrono::time_point<std::chrono::system_clock> m_tp1, m_tp2;
 
@@ -742,9 +980,15 @@ namespace olc
 		// The main engine thread
 		void		EngineThread();
 
+		// Draw() without marking the pixel dirty, the drawing routines mark
+		// everything they touched once
+		bool		Plot(int32_t x, int32_t y, Pixel p);
+		void		MarkDrawn(int32_t x, int32_t y, int32_t w, int32_t h);
+
 		// At the very end of this file, chooses which
 		// components to compile
 		void        olc_ConfigureSystem();
+		void        olc_ConfigureHeadless();
 
 		// If anything sets this flag to false, the engine
 		// "should" shut down gracefully
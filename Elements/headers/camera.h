@@ -0,0 +1,80 @@
+#pragma once
+#include "PixelGameEngine.h"
+#include <algorithm>
+
+// The window of the world shown on screen. The world can be any size, only
+// the cells inside this window are ever drawn.
+struct Camera
+{
+	static constexpr int minZoom = -4;
+	static constexpr int maxZoom = 3;
+
+	// World cell at the top left of the screen
+	int x = 0;
+	int y = 0;
+	// Screen size in pixels
+	int width = 0;
+	int height = 0;
+	// Each cell covers 2^zoom screen pixels across. Below zero only every
+	// 2^-zoom th cell is shown.
+	int zoom = 0;
+
+	bool operator==(const Camera& other) const
+	{
+		return x == other.x && y == other.y && width == other.width && height == other.height && zoom == other.zoom;
+	}
+	bool operator!=(const Camera& other) const { return !(*this == other); }
+
+	// Cells between the left edge of the screen and screen pixel s
+	int ToCells(int s) const { return zoom >= 0 ? s >> zoom : s << -zoom; }
+	// Screen pixels covered by n cells, rounded down
+	int ToPixels(int n) const { return zoom >= 0 ? n << zoom : n >> -zoom; }
+
+	olc::vi2d ToWorld(const olc::vi2d& screen) const { return { x + ToCells(screen.x), y + ToCells(screen.y) }; }
+
+	// Width and height of the window in cells, counting partly visible ones
+	int GetCellsX() const { return std::max(ToCells(width + ToPixels(1) - 1), 1); }
+	int GetCellsY() const { return std::max(ToCells(height + ToPixels(1) - 1), 1); }
+
+	// Keeps the window inside a world of the given size. A world smaller
+	// than the window stays at the top left.
+	void Clamp(int worldWidth, int worldHeight)
+	{
+		zoom = std::min(std::max(zoom, int(minZoom)), int(maxZoom));
+		x = std::max(std::min(x, worldWidth - GetCellsX()), 0);
+		y = std::max(std::min(y, worldHeight - GetCellsY()), 0);
+	}
+
+	// Changes the zoom while the cell under the screen pixel stays put
+	void ZoomAt(const olc::vi2d& screen, int steps)
+	{
+		olc::vi2d anchor = ToWorld(screen);
+		zoom = std::min(std::max(zoom + steps, int(minZoom)), int(maxZoom));
+		x = anchor.x - ToCells(screen.x);
+		y = anchor.y - ToCells(screen.y);
+	}
+
+	// Adds the screen pixels showing any part of the given world region
+	void AddToView(const olc::DirtyRegion& world, olc::DirtyRegion& view) const
+	{
+		for (const auto& r : world.vRects)
+		{
+			// Clipped to the window first, so every offset is positive
+			int x0 = std::max(r.x0, int32_t(x)) - x;
+			int y0 = std::max(r.y0, int32_t(y)) - y;
+			int x1 = std::min(r.x1, int32_t(x + GetCellsX() + 1)) - x;
+			int y1 = std::min(r.y1, int32_t(y + GetCellsY() + 1)) - y;
+			if (x0 >= x1 || y0 >= y1)
+				continue;
+
+			// Zoomed out, a cell range maps to the pixels whose cells it contains
+			int sx0 = zoom >= 0 ? ToPixels(x0) : (x0 + (1 << -zoom) - 1) >> -zoom;
+			int sy0 = zoom >= 0 ? ToPixels(y0) : (y0 + (1 << -zoom) - 1) >> -zoom;
+			int sx1 = zoom >= 0 ? ToPixels(x1) : (x1 + (1 << -zoom) - 1) >> -zoom;
+			int sy1 = zoom >= 0 ? ToPixels(y1) : (y1 + (1 << -zoom) - 1) >> -zoom;
+			if (sx0 < sx1 && sy0 < sy1)
+				view.Add(sx0, sy0, sx1 - sx0, sy1 - sy0);
+		}
+		view.Clip(width, height);
+	}
+};
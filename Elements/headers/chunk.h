@@ -0,0 +1,71 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <climits>
+
+// A fixed-size square region of the world. Each chunk tracks the rectangle
+// of cells that needs processing, so settled areas cost nothing per tick.
+// Bounds are inclusive world cell coordinates, and a rectangle with
+// minX > maxX is empty, which means the chunk is asleep.
+//
+// The next tick's rectangle can be grown by workers processing neighbouring
+// chunks at the same time, so it is updated atomically.
+struct Chunk
+{
+	int x = 0;
+	int y = 0;
+	int width = 0;
+	int height = 0;
+
+	//*** Rectangle processed during the current tick
+	int minX = INT_MAX, minY = INT_MAX;
+	int maxX = INT_MIN, maxY = INT_MIN;
+
+	//*** Rectangle accumulated for the next tick
+	std::atomic<int> nextMinX{ INT_MAX }, nextMinY{ INT_MAX };
+	std::atomic<int> nextMaxX{ INT_MIN }, nextMaxY{ INT_MIN };
+
+	bool IsAwake() const { return minX <= maxX; }
+
+	// Grows the next tick's rectangle to cover [x0, x1] x [y0, y1],
+	// clipped to the chunk
+	void Expand(int x0, int y0, int x1, int y1)
+	{
+		x0 = std::max(x0, x);
+		y0 = std::max(y0, y);
+		x1 = std::min(x1, x + width - 1);
+		y1 = std::min(y1, y + height - 1);
+		if (x0 > x1 || y0 > y1)
+			return;
+
+		AtomicMin(nextMinX, x0);
+		AtomicMin(nextMinY, y0);
+		AtomicMax(nextMaxX, x1);
+		AtomicMax(nextMaxY, y1);
+	}
+
+	// Promotes the accumulated rectangle to the current one. A chunk that
+	// saw no movement ends up with an empty rectangle and goes to sleep.
+	void Step()
+	{
+		minX = nextMinX.exchange(INT_MAX, std::memory_order_relaxed);
+		minY = nextMinY.exchange(INT_MAX, std::memory_order_relaxed);
+		maxX = nextMaxX.exchange(INT_MIN, std::memory_order_relaxed);
+		maxY = nextMaxY.exchange(INT_MIN, std::memory_order_relaxed);
+	}
+
+private:
+	// The plain load lets the common case, a rectangle that already
+	// covers the change, finish without a locked instruction
+	static void AtomicMin(std::atomic<int>& value, int v)
+	{
+		int current = value.load(std::memory_order_relaxed);
+		while (v < current && !value.compare_exchange_weak(current, v, std::memory_order_relaxed));
+	}
+
+	static void AtomicMax(std::atomic<int>& value, int v)
+	{
+		int current = value.load(std::memory_order_relaxed);
+		while (v > current && !value.compare_exchange_weak(current, v, std::memory_order_relaxed));
+	}
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include "PixelGameEngine.h"
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The cells of one chunk while it is out of the world. Empty planes mean
+// the chunk holds nothing but empty space.
+struct ChunkCells
+{
+	std::vector<uint8_t> materials;
+	std::vector<olc::Pixel> colors;
+
+	bool Empty() const { return materials.empty(); }
+};
+
+// Where the chunks of an unbounded world live while they are not resident:
+// one small run-length encoded file per chunk in a directory, and nothing
+// at all for empty ones. Saving and prefetching run on a thread of their
+// own, so the simulation only waits on the disk for a chunk it needs that
+// was not prefetched in time.
+class ChunkStore
+{
+public:
+	// Creates the directory if needed. Chunks are chunkSize cells square.
+	ChunkStore(const std::string& directory, int chunkSize);
+	~ChunkStore();
+
+	ChunkStore(const ChunkStore&) = delete;
+	ChunkStore& operator=(const ChunkStore&) = delete;
+
+	int GetChunkSize() const { return chunkSize; }
+
+	// Hands over a chunk to be written, at the given chunk coordinates
+	void Save(olc::vi2d chunk, ChunkCells&& cells);
+
+	// Replaces the set of chunks to keep loaded ahead of need. Loaded chunks
+	// no longer in the set are dropped, so memory stays bounded by the set.
+	void Prefetch(const std::vector<olc::vi2d>& chunks);
+
+	// The stored cells of a chunk, read on the spot if not prefetched
+	ChunkCells Load(olc::vi2d chunk);
+
+	// Blocks until every saved chunk is on disk
+	void Flush();
+
+private:
+	static uint64_t Key(olc::vi2d chunk) { return (uint64_t(uint32_t(chunk.x)) << 32) | uint32_t(chunk.y); }
+	std::string PathOf(uint64_t key) const;
+
+	bool WriteFile(uint64_t key, const ChunkCells& cells) const;
+	ChunkCells ReadFile(uint64_t key) const;
+	void Run();
+
+	std::string directory;
+	int chunkSize;
+	std::thread thread;
+
+	//*** Guarded by mutex
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable flushed;
+	// Chunks saved but not yet written. An entry stays until its file is
+	// complete, so Load never reads a file that is being written.
+	std::map<uint64_t, std::shared_ptr<const ChunkCells>> writes;
+	std::set<uint64_t> wanted;
+	std::vector<uint64_t> toLoad;
+	std::map<uint64_t, ChunkCells> loaded;
+	bool stopping = false;
+};
@@ -1,78 +1,201 @@
 #pragma once
 #include "PixelGameEngine.h"
 #include "simulation.h"
-#include <stdlib.h>     /* srand, rand */
+#include "simulationthread.h"
+#include <cstdio>
 
 
 class Game : public olc::PixelGameEngine
 {
 public:
-	Game()
+	// A synchronous game runs exactly one tick per frame on the engine
+	// thread, for runs that have to be reproducible: headless runs, and
+	// recording or replaying input
+	Game(uint64_t seed, const olc::vi2d& worldSize, bool synchronous = false)
+		: seed(seed), worldSize(worldSize), synchronous(synchronous)
 	{
 		sAppName = "Elements";
 	}
 
+	// Makes the world unbounded, keeping the chunks away from the camera in
+	// the given directory. Call before Start().
+	void StreamFrom(const std::string& directory)
+	{
+		chunkStore.reset(new ChunkStore(directory, simulation.GetChunkSize()));
+	}
+
+	uint64_t GetWorldHash() const { return simulation.Hash(); }
+	uint64_t GetTick() const { return simulation.GetTick(); }
+
 private:
+	static constexpr double ticksPerSecond = 60.0;
+
+	// Outlives the simulation and its thread, which both use it
+	std::unique_ptr<ChunkStore> chunkStore;
 	Simulation simulation;
+	SimulationThread simulationThread{ simulation };
+	uint64_t seed = 0;
+	// The world is independent of the screen, which shows the part of it
+	// the camera looks at. A streaming world is unbounded and this is the
+	// size of the part kept in memory.
+	olc::vi2d worldSize;
+	bool synchronous = false;
+	// Arrow keys or dragging with the middle button pan, ctrl and the wheel zoom
+	Camera camera;
+	olc::vi2d dragAnchor = { 0, 0 };
+	static constexpr int panSpeed = 4;
+	// Material placed by the left mouse button, picked with the number keys
+	uint8_t brushMaterial = MaterialId::Sand;
+	int brushRadius = 4;
+	float brushDensity = 0.15f;
+	// B throws the loose cells around the mouse into the air
+	static constexpr float burstSpeed = 6.0f;
+	// M switches water between whole cells and the mass model
+	WaterModel waterModel = WaterModel::Cells;
+	olc::vi2d lastMouse = { 0, 0 };
+	// F3 shows the time spent in each phase of a frame and of a tick
+	bool showProfiler = false;
+	// F4 starts recording a trace, and pressing it again saves it here
+	const char* traceFile = "trace.json";
+	// F5 saves the world here and F9 loads it back. Snapshots hold a bounded
+	// world, so they are off while streaming.
+	const char* snapshotFile = "world.snapshot";
 
 	bool OnUserCreate() override
 	{
-		srand(time(NULL));
-		simulation.InitSimulation(ScreenWidth(), ScreenHeight());
+		simulation.SetSeed(seed);
+		simulation.InitSimulation(worldSize.x, worldSize.y);
+		if (chunkStore)
+			simulation.SetChunkStore(chunkStore.get());
+		camera.width = ScreenWidth();
+		camera.height = ScreenHeight();
+		camera.x = (simulation.GetWidth() - camera.width) / 2;
+		camera.y = (simulation.GetHeight() - camera.height) / 2;
+		ClampCamera();
+		simulationThread.SetCamera(camera);
+		simulationThread.SetProfiler(&GetProfiler());
+		if (!synchronous)
+			simulationThread.Start(ticksPerSecond);
 
 		return true;
 	}
 
+	bool OnUserDestroy() override
+	{
+		simulationThread.Stop();
+		// What is in memory goes to the store too, so the next run with the
+		// same directory carries on from here
+		simulation.StoreResident();
+		return true;
+	}
+
+	// An unbounded world has no edges to keep the camera from
+	void ClampCamera()
+	{
+		if (!simulation.IsStreaming())
+			camera.Clamp(simulation.GetWidth(), simulation.GetHeight());
+	}
+
 	bool OnUserUpdate(float fElapsedTime) override
 	{
-		Clear(olc::BLACK);
+		int materialCount = std::min(simulation.GetMaterials().GetCount(), 10);
+		for (int i = 1; i < materialCount; i++)
+			if (GetKey(olc::Key(olc::Key::K0 + i)).bPressed)
+				brushMaterial = uint8_t(i);
 
-		olc::HWButton leftClick = GetMouse(0);
-		if (leftClick.bHeld)
+		olc::vi2d screenMouse = { GetMouseX(), GetMouseY() };
+		if (GetKey(olc::Key::CTRL).bHeld)
 		{
-			//simulation.CreateObject(GetMouseX(), GetMouseY(), 1);
-			simulation.CreateObject(GetMouseX() + std::rand() % 2, GetMouseY() - std::rand() % 14, 1);
-			simulation.CreateObject(GetMouseX() + std::rand() % 4, GetMouseY() - std::rand() % 14, 1);
-			simulation.CreateObject(GetMouseX() + std::rand() % 6, GetMouseY() - std::rand() % 14, 1);
-			simulation.CreateObject(GetMouseX() - std::rand() % 6, GetMouseY() - std::rand() % 14, 1);
-			simulation.CreateObject(GetMouseX() - std::rand() % 3, GetMouseY() - std::rand() % 14, 1);
-			simulation.CreateObject(GetMouseX() - std::rand() % 2, GetMouseY() - std::rand() % 14, 1);
+			if (GetMouseWheel() != 0)
+				camera.ZoomAt(screenMouse, GetMouseWheel() > 0 ? 1 : -1);
 		}
-		 
-		olc::HWButton rightClick = GetMouse(1);
-		if (rightClick.bHeld)
+		else if (GetMouseWheel() > 0)
+			brushRadius = std::min(brushRadius + 1, 32);
+		else if (GetMouseWheel() < 0)
+			brushRadius = std::max(brushRadius - 1, 0);
+
+		int pan = std::max(camera.ToCells(panSpeed), 1);
+		if (GetKey(olc::Key::LEFT).bHeld) camera.x -= pan;
+		if (GetKey(olc::Key::RIGHT).bHeld) camera.x += pan;
+		if (GetKey(olc::Key::UP).bHeld) camera.y -= pan;
+		if (GetKey(olc::Key::DOWN).bHeld) camera.y += pan;
+
+		// The cell grabbed with the middle button stays under the cursor
+		if (GetMouse(2).bPressed)
+			dragAnchor = camera.ToWorld(screenMouse);
+		if (GetMouse(2).bHeld)
 		{
-			//simulation.CreateObject(GetMouseX(), GetMouseY(), 2);
-			simulation.CreateObject(GetMouseX() + std::rand() % 2, GetMouseY() - std::rand() % 14, 2);
-			simulation.CreateObject(GetMouseX() + std::rand() % 4, GetMouseY() - std::rand() % 14, 2);
-			simulation.CreateObject(GetMouseX() + std::rand() % 6, GetMouseY() - std::rand() % 14, 2);
-			simulation.CreateObject(GetMouseX() - std::rand() % 6, GetMouseY() - std::rand() % 14, 2);
-			simulation.CreateObject(GetMouseX() - std::rand() % 3, GetMouseY() - std::rand() % 14, 2);
-			simulation.CreateObject(GetMouseX() - std::rand() % 2, GetMouseY() - std::rand() % 14, 2);
+			camera.x = dragAnchor.x - camera.ToCells(screenMouse.x);
+			camera.y = dragAnchor.y - camera.ToCells(screenMouse.y);
 		}
 
+		ClampCamera();
+		simulationThread.SetCamera(camera);
+
+		// Paint along the path the mouse took since the last frame, so fast
+		// strokes leave no gaps
+		olc::vi2d mouse = camera.ToWorld(screenMouse);
+		if (!GetMouse(0).bHeld && !GetMouse(1).bHeld)
+			lastMouse = mouse;
 
+		if (GetMouse(0).bHeld)
+			simulationThread.Push(SimulationCommand::Line(lastMouse.x, lastMouse.y, mouse.x, mouse.y, brushRadius, brushMaterial, brushDensity));
+		if (GetMouse(1).bHeld)
+			simulationThread.Push(SimulationCommand::Line(lastMouse.x, lastMouse.y, mouse.x, mouse.y, brushRadius, MaterialId::Water, brushDensity));
+		lastMouse = mouse;
 
-		simulation.ProcessSimulation();
+		if (GetKey(olc::Key::B).bPressed)
+			simulationThread.Push(SimulationCommand::Burst(mouse.x, mouse.y, brushRadius * 2 + 4, burstSpeed));
+		if (GetKey(olc::Key::M).bPressed)
+		{
+			waterModel = waterModel == WaterModel::Cells ? WaterModel::Mass : WaterModel::Cells;
+			simulationThread.Push(SimulationCommand::SetWaterModel(waterModel));
+		}
 
-		Object* world = simulation.world;
-		//unsigned char* world = simulation.world;
-		for (int x = 0; x < ScreenWidth(); x++)
-			for (int y = 0; y < ScreenHeight(); y++)
+		if (synchronous)
+			simulationThread.Step();
+
+		// Layer 0 displays the newest published frame directly, so there is
+		// no per-pixel draw pass. Nothing else may draw to it; overlays use
+		// decals. Without a new frame the last one stays on screen.
+		if (Frame* frame = simulationThread.AcquireFrame())
+			SetLayerExternalData(0, frame->pixels.data(), &frame->changed);
+
+		if (GetKey(olc::Key::F3).bPressed)
+			showProfiler = !showProfiler;
+		if (showProfiler)
+			DrawProfiler();
+
+		if (GetKey(olc::Key::F4).bPressed)
+		{
+			if (olc::Trace::IsRecording())
+			{
+				olc::Trace::Stop();
+				olc::Trace::Save(traceFile);
+			}
+			else
+				olc::Trace::Start();
+		}
+		if (olc::Trace::IsRecording())
+			DrawStringDecal({ float(ScreenWidth() - 42), 2.0f }, "TRACE", olc::RED);
+
+		if ((GetKey(olc::Key::F5).bPressed || GetKey(olc::Key::F9).bPressed) && !simulation.IsStreaming())
+		{
+			// The world may only be touched while its thread is stopped
+			bool running = simulationThread.IsRunning();
+			simulationThread.Stop();
+			if (GetKey(olc::Key::F5).bPressed)
+				simulation.SaveSnapshot(snapshotFile);
+			else if (simulation.LoadSnapshot(snapshotFile))
 			{
-				switch (world[y * ScreenWidth() + x].id)
-				{
-					case 1:
-					{
-						olc::Pixel color = world[y * ScreenWidth() + x].color;
-						Draw(x, y, color); // Sand
-						break;
-					}
-					case 2:
-						Draw(x, y, world[y * ScreenWidth() + x].color); // Water
-						break;
-				}
+				waterModel = simulation.GetWaterModel();
+				ClampCamera();
+				simulationThread.SetCamera(camera);
+				simulationThread.Invalidate();
 			}
+			if (running)
+				simulationThread.Start(ticksPerSecond);
+		}
 
 		olc::HWButton escape = GetKey(olc::Key::ESCAPE);
 		if (escape.bPressed)
@@ -80,4 +203,21 @@ private:
 		else
 			return true;
 	}
+
+	// One line per phase: average and 99th percentile over the recent history
+	void DrawProfiler()
+	{
+		olc::Profiler& profiler = GetProfiler();
+		uint32_t phases = profiler.GetPhaseCount();
+		FillRectDecal({ 0.0f, 0.0f }, { 180.0f, float(phases * 10 + 14) }, olc::Pixel(0, 0, 0, 160));
+		DrawStringDecal({ 2.0f, 2.0f }, "phase         avg    p99 ms", olc::YELLOW);
+
+		char line[64];
+		for (uint32_t i = 0; i < phases; i++)
+		{
+			olc::Profiler::Stats stats = profiler.GetStats(i);
+			snprintf(line, sizeof(line), "%-12s %6.2f %6.2f", profiler.GetPhaseName(i).c_str(), stats.fAverageMs, stats.fP99Ms);
+			DrawStringDecal({ 2.0f, float(12 + i * 10) }, line);
+		}
+	}
 };
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+#include "PixelGameEngine.h"
+#include <array>
+#include <cfloat>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// How a material moves. Each class has its own update kernel, so adding
+// materials never adds branches to the simulation loop.
+enum class MovementClass : uint8_t
+{
+	Static,
+	Powder,
+	Liquid,
+	Gas
+};
+
+// Ids of the built-in materials, in registration order
+namespace MaterialId
+{
+	enum : uint8_t
+	{
+		Empty = 0,
+		Sand,
+		Water,
+		Stone,
+		Oil,
+		Smoke,
+		Steam,
+		Ice,
+		Glass,
+		Lava,
+		BuiltInCount
+	};
+}
+
+// Temperature of anything nothing heats or cools
+constexpr float ambientTemperature = 20.0f;
+
+struct Material
+{
+	std::string name;
+	MovementClass movement = MovementClass::Static;
+	// A moving material displaces any non-static material of lower density
+	uint8_t density = 0;
+	// Chance per tick of catching fire next to a flame, from 0 to 1
+	float flammability = 0.0f;
+	// New cells pick one of these colors at random
+	std::vector<olc::Pixel> palette;
+	// How readily heat passes through, from 0 to 1, and the temperature new
+	// cells bring with them
+	float conductivity = 0.0f;
+	float temperature = ambientTemperature;
+	// Turns into hotInto above hotAt, and into coldInto below coldAt
+	float hotAt = FLT_MAX;
+	uint8_t hotInto = 0;
+	float coldAt = -FLT_MAX;
+	uint8_t coldInto = 0;
+	// Share of the way to its temperature a cell draws its block each tick,
+	// for materials that keep themselves hot, such as lava. The field has
+	// no heat moving with the cells, so this is what keeps a flow of them hot.
+	float glow = 0.0f;
+	// Mean ticks a cell lasts before it vanishes, 0 for as long as it is left
+	int lifetime = 0;
+};
+
+// Every material the simulation knows, indexed by the id stored in the
+// material plane. The properties the update kernels read are mirrored into
+// flat tables so a probe touches one byte instead of a whole Material.
+class MaterialRegistry
+{
+public:
+	static constexpr int maxMaterials = 256;
+
+	MaterialRegistry();
+
+	// Returns the id of the new material
+	uint8_t Register(const Material& material);
+
+	const Material& Get(uint8_t id) const { return definitions[id]; }
+	int GetCount() const { return int(definitions.size()); }
+	MovementClass GetMovement(uint8_t id) const { return movement[id]; }
+	uint8_t GetDensity(uint8_t id) const { return density[id]; }
+	float GetConductivity(uint8_t id) const { return conductivity[id]; }
+	float GetTemperature(uint8_t id) const { return temperature[id]; }
+	float GetGlow(uint8_t id) const { return glow[id]; }
+	float GetHotAt(uint8_t id) const { return hotAt[id]; }
+	float GetColdAt(uint8_t id) const { return coldAt[id]; }
+	int GetLifetime(uint8_t id) const { return lifetime[id]; }
+
+	// What a cell of material id turns into at the given temperature,
+	// id itself if it stays as it is
+	uint8_t Transform(uint8_t id, float heat) const
+	{
+		return heat > hotAt[id] ? hotInto[id] : heat < coldAt[id] ? coldInto[id] : id;
+	}
+
+	// True if a moving cell of material a may take the place of b
+	bool CanDisplace(uint8_t a, uint8_t b) const
+	{
+		return b == MaterialId::Empty || (movement[b] != MovementClass::Static && density[a] > density[b]);
+	}
+
+private:
+	std::vector<Material> definitions;
+	std::array<MovementClass, maxMaterials> movement{};
+	std::array<uint8_t, maxMaterials> density{};
+	std::array<float, maxMaterials> conductivity{};
+	std::array<float, maxMaterials> temperature{};
+	std::array<float, maxMaterials> hotAt{};
+	std::array<uint8_t, maxMaterials> hotInto{};
+	std::array<float, maxMaterials> coldAt{};
+	std::array<uint8_t, maxMaterials> coldInto{};
+	std::array<float, maxMaterials> glow{};
+	std::array<int, maxMaterials> lifetime{};
+};
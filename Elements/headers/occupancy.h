@@ -0,0 +1,107 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// One bit per cell, set where the material plane is not empty. Each row is
+// stored as words of 64 cells, so a loop over a row skips empty stretches
+// a word at a time and only visits cells that hold something.
+//
+// Words line up with chunks, and during a phase a worker writes its own
+// chunk's words and, within sharedEdge cells of either end, those of the
+// chunks next to it. Only cells there can see two writers at once, so only
+// they pay for a locked update.
+class OccupancyMap
+{
+public:
+	static constexpr int wordBits = 64;
+
+	void Reset(int width, int height, int edge)
+	{
+		wordsPerRow = (width + wordBits - 1) / wordBits;
+		rows = height;
+		sharedEdge = edge;
+		words.reset(new std::atomic<uint64_t>[size_t(wordsPerRow) * rows]);
+		for (size_t i = 0; i < size_t(wordsPerRow) * rows; ++i)
+			words[i].store(0, std::memory_order_relaxed);
+	}
+
+	// Sets every bit from a material plane of the same size
+	void Build(const std::vector<uint8_t>& materials, int width)
+	{
+		for (int y = 0; y < rows; ++y)
+		{
+			for (int w = 0; w < wordsPerRow; ++w)
+			{
+				const uint8_t* cells = materials.data() + size_t(y) * width + w * wordBits;
+				int count = std::min(int(wordBits), width - w * wordBits);
+				uint64_t word = 0;
+				for (int i = 0; i < count; ++i)
+					word |= uint64_t(cells[i] != 0) << i;
+				words[size_t(y) * wordsPerRow + w].store(word, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void Set(int x, int y) { Assign(x, y, true); }
+	void Clear(int x, int y) { Assign(x, y, false); }
+
+	void Assign(int x, int y, bool occupied)
+	{
+		std::atomic<uint64_t>& word = Word(x, y);
+		int bit = x & (wordBits - 1);
+		uint64_t mask = uint64_t(1) << bit;
+		if (unsigned(bit - sharedEdge) < unsigned(wordBits - 2 * sharedEdge))
+		{
+			uint64_t value = word.load(std::memory_order_relaxed);
+			word.store((value & ~mask) | (uint64_t(occupied) << bit), std::memory_order_relaxed);
+		}
+		else if (occupied)
+			word.fetch_or(mask, std::memory_order_relaxed);
+		else
+			word.fetch_and(~mask, std::memory_order_relaxed);
+	}
+
+	bool Test(int x, int y) const
+	{
+		return (GetWord(x / wordBits, y) >> (x & (wordBits - 1))) & 1;
+	}
+
+	// The 64 cells of row y starting at x = wordX * 64, bit i for x + i
+	uint64_t GetWord(int wordX, int y) const
+	{
+		return words[size_t(y) * wordsPerRow + wordX].load(std::memory_order_relaxed);
+	}
+
+	// Bits lo to hi inclusive, both in [0, 63]
+	static uint64_t Mask(int lo, int hi)
+	{
+		return (~uint64_t(0) >> (wordBits - 1 - hi)) & (~uint64_t(0) << lo);
+	}
+
+	// Index of the highest set bit of a non-zero word
+	static int HighestBit(uint64_t word)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse64(&index, word);
+		return int(index);
+#else
+		return 63 - __builtin_clzll(word);
+#endif
+	}
+
+private:
+	std::atomic<uint64_t>& Word(int x, int y) { return words[size_t(y) * wordsPerRow + x / wordBits]; }
+
+	std::unique_ptr<std::atomic<uint64_t>[]> words;
+	int wordsPerRow = 0;
+	int rows = 0;
+	int sharedEdge = wordBits / 2;
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include "PixelGameEngine.h"
+#include <cstdint>
+#include <vector>
+
+// Cells thrown out of the grid, such as splashes and debris. While in the
+// air they are points with a velocity, in cells and cells per tick, and
+// are put back into the grid where they land. Each field is an array of
+// its own, so moving them all is a plain loop over floats.
+struct FlyingParticles
+{
+	std::vector<float> x, y;
+	std::vector<float> vx, vy;
+	std::vector<uint8_t> material;
+	std::vector<olc::Pixel> color;
+	// Water each one carries, as in the mass plane of the grid
+	std::vector<float> mass;
+
+	size_t Size() const { return x.size(); }
+	bool Empty() const { return x.empty(); }
+
+	void Add(float px, float py, float pvx, float pvy, uint8_t m, olc::Pixel c, float pm)
+	{
+		x.push_back(px); y.push_back(py);
+		vx.push_back(pvx); vy.push_back(pvy);
+		material.push_back(m);
+		color.push_back(c);
+		mass.push_back(pm);
+	}
+
+	// Copies particle from into slot to, for compacting the arrays
+	void Move(size_t from, size_t to)
+	{
+		x[to] = x[from]; y[to] = y[from];
+		vx[to] = vx[from]; vy[to] = vy[from];
+		material[to] = material[from];
+		color[to] = color[from];
+		mass[to] = mass[from];
+	}
+
+	void Resize(size_t count)
+	{
+		x.resize(count); y.resize(count);
+		vx.resize(count); vy.resize(count);
+		material.resize(count);
+		color.resize(count);
+		mass.resize(count);
+	}
+
+	void Append(const FlyingParticles& other)
+	{
+		x.insert(x.end(), other.x.begin(), other.x.end());
+		y.insert(y.end(), other.y.begin(), other.y.end());
+		vx.insert(vx.end(), other.vx.begin(), other.vx.end());
+		vy.insert(vy.end(), other.vy.begin(), other.vy.end());
+		material.insert(material.end(), other.material.begin(), other.material.end());
+		color.insert(color.end(), other.color.begin(), other.color.end());
+		mass.insert(mass.end(), other.mass.begin(), other.mass.end());
+	}
+
+	void Clear()
+	{
+		x.clear(); y.clear();
+		vx.clear(); vy.clear();
+		material.clear();
+		color.clear();
+		mass.clear();
+	}
+};
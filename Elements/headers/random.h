@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+
+// PCG32 (pcg-random.org): a small, fast generator with 2^63 independent
+// streams. Unlike std::rand it has no shared state and produces the same
+// sequence on every platform, so a world seed reproduces a whole run.
+class Random
+{
+	uint64_t state = 0;
+	uint64_t increment = 1;
+
+public:
+	Random(uint64_t seed = 0, uint64_t stream = 0)
+	{
+		Seed(seed, stream);
+	}
+
+	void Seed(uint64_t seed, uint64_t stream = 0)
+	{
+		state = 0;
+		increment = (stream << 1) | 1;
+		Next();
+		state += seed;
+		Next();
+	}
+
+	// The raw generator state, for saving and restoring a stream exactly
+	uint64_t GetState() const { return state; }
+	uint64_t GetIncrement() const { return increment; }
+	void Restore(uint64_t savedState, uint64_t savedIncrement)
+	{
+		state = savedState;
+		increment = savedIncrement | 1;
+	}
+
+	uint32_t Next()
+	{
+		uint64_t old = state;
+		state = old * 6364136223846793005ULL + increment;
+		uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+		uint32_t rot = uint32_t(old >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+	}
+
+	// Uniform in [0, n), using a multiply instead of a division
+	int Below(int n)
+	{
+		return int((uint64_t(Next()) * uint32_t(n)) >> 32);
+	}
+
+	// Uniform in [min, max]
+	int Range(int min, int max)
+	{
+		return min + Below(max - min + 1);
+	}
+
+	float Float()
+	{
+		return float(Next() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// SplitMix64 finaliser, for deriving seeds from a seed and a counter
+	static uint64_t Mix(uint64_t x)
+	{
+		x += 0x9E3779B97F4A7C15ULL;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		return x ^ (x >> 31);
+	}
+};
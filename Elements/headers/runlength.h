@@ -0,0 +1,116 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Run-length coding for world planes on disk, used by snapshots and the
+// chunk store
+
+// Runs shorter than this are cheaper stored as literals
+constexpr size_t minRun = 3;
+
+inline void WriteVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(uint8_t(value) | 0x80);
+		value >>= 7;
+	}
+	out.push_back(uint8_t(value));
+}
+
+inline bool ReadVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && in < end; shift += 7)
+	{
+		uint8_t byte = *in++;
+		value |= uint64_t(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+template<typename T>
+void Append(std::vector<uint8_t>& out, const T* values, size_t count)
+{
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+	out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+// Each block starts with a varint n. An even n is a run of n / 2 copies
+// of the value that follows, an odd n is n / 2 values stored as they are.
+// Empty space and settled material become a handful of bytes per row.
+template<typename T>
+void EncodeRuns(const T* data, size_t count, std::vector<uint8_t>& out)
+{
+	size_t i = 0;
+	while (i < count)
+	{
+		size_t run = 1;
+		while (i + run < count && data[i + run] == data[i])
+			++run;
+
+		if (run >= minRun)
+		{
+			WriteVarint(out, uint64_t(run) << 1);
+			Append(out, data + i, 1);
+			i += run;
+			continue;
+		}
+
+		// Literals continue up to the start of the next long run
+		size_t start = i;
+		while (i < count)
+		{
+			size_t ahead = 1;
+			while (i + ahead < count && ahead < minRun && data[i + ahead] == data[i])
+				++ahead;
+			if (ahead >= minRun)
+				break;
+			i += ahead;
+		}
+
+		WriteVarint(out, (uint64_t(i - start) << 1) | 1);
+		Append(out, data + start, i - start);
+	}
+}
+
+template<typename T>
+bool DecodeRuns(const uint8_t* in, size_t size, T* data, size_t count)
+{
+	const uint8_t* end = in + size;
+	size_t i = 0;
+	while (i < count)
+	{
+		uint64_t block;
+		if (!ReadVarint(in, end, block))
+			return false;
+
+		uint64_t length = block >> 1;
+		if (length == 0 || length > count - i)
+			return false;
+
+		if (block & 1)
+		{
+			if (uint64_t(end - in) < length * sizeof(T))
+				return false;
+			memcpy(data + i, in, size_t(length) * sizeof(T));
+			in += length * sizeof(T);
+		}
+		else
+		{
+			if (size_t(end - in) < sizeof(T))
+				return false;
+			T value;
+			memcpy(&value, in, sizeof(T));
+			in += sizeof(T);
+			std::fill(data + i, data + i + length, value);
+		}
+		i += size_t(length);
+	}
+	return in == end;
+}
@@ -1,35 +1,493 @@
 #pragma once
 #include "PixelGameEngine.h"
-#include <array>
+#include "camera.h"
+#include "chunk.h"
+#include "chunkstore.h"
+#include "material.h"
+#include "occupancy.h"
+#include "particles.h"
+#include "random.h"
+#include "threadpool.h"
+#include <cstdint>
+#include <string>
+#include <vector>
 
-struct Object
+// Counters gathered during the last ProcessSimulation call
+struct TickStats
 {
-	int id = 0;
-	olc::Pixel color = olc::BLACK;
+	// Occupied cells whose update ran, water moved by the mass model included
+	int processedCells = 0;
+	// Cells skipped because they had already moved this tick. Before tick
+	// stamps existed each of these was a second update of the same particle.
+	int revisitedCells = 0;
+	// Cells in flight out of the grid once the tick is over
+	int flyingParticles = 0;
 };
 
-class Simulation
+// A source that sprays material every tick, such as a tap or a sand fall
+struct Emitter
 {
-	int screenWidth;
-	int screenHeight;
+	int x = 0;
+	int y = 0;
+	int radius = 0;
+	uint8_t material = 0;
+	// Cells spawned per tick
+	int rate = 1;
+};
 
-	// Terrain size
+// How water moves
+enum class WaterModel : uint8_t
+{
+	// Whole cells, moved by the liquid kernel like any other liquid
+	Cells,
+	// Each cell holds some amount of water, which flows between neighbours
+	// until the levels even out. See fluid.cpp.
+	Mass
+};
 
-	//std::vector<Object> createdObjects;
+// A change to the world made from outside the tick, such as a brush stroke.
+// Commands from another thread are queued and applied in order between ticks.
+// Positions are world coordinates, see Simulation::GetOrigin.
+struct SimulationCommand
+{
+	enum class Type : uint8_t
+	{
+		Line,
+		Rect,
+		Spray,
+		AddEmitter,
+		RemoveEmitter,
+		Burst,
+		SetWaterModel
+	};
 
-public:
-	//unsigned char* world = nullptr;
-	Object* world;
+	Type type = Type::Line;
+	// Line: both ends. Rect: inclusive corners. Spray, emitters and bursts: centre.
+	int x0 = 0, y0 = 0;
+	int x1 = 0, y1 = 0;
+	int radius = 0;
+	uint8_t material = 0;
+	float density = 1.0f;
+	// Spray: cells spawned. AddEmitter: rate. RemoveEmitter: index.
+	int count = 0;
+	// Burst: cells per tick the cells are thrown at
+	float speed = 0.0f;
+	WaterModel waterModel = WaterModel::Cells;
+
+	static SimulationCommand Line(int x0, int y0, int x1, int y1, int radius, uint8_t material, float density)
+	{
+		SimulationCommand command;
+		command.type = Type::Line;
+		command.x0 = x0; command.y0 = y0;
+		command.x1 = x1; command.y1 = y1;
+		command.radius = radius;
+		command.material = material;
+		command.density = density;
+		return command;
+	}
 
-	Simulation() 
+	static SimulationCommand Burst(int x, int y, int radius, float speed)
 	{
+		SimulationCommand command;
+		command.type = Type::Burst;
+		command.x0 = x; command.y0 = y;
+		command.radius = radius;
+		command.speed = speed;
+		return command;
+	}
+
+	static SimulationCommand SetWaterModel(WaterModel model)
+	{
+		SimulationCommand command;
+		command.type = Type::SetWaterModel;
+		command.waterModel = model;
+		return command;
+	}
+};
+
+class Simulation
+{
+	int worldWidth = 0;
+	int worldHeight = 0;
 
+	// World planes, one entry per cell indexed by y * worldWidth + x.
+	// The material plane is what the hot loop probes, so it is kept apart
+	// from everything else. Any new per-cell plane must be handled in
+	// SetCell, ClearCell, MoveCell and SwapCells.
+	std::vector<uint8_t> materials;
+	std::vector<olc::Pixel> colors;
+	// Low byte of the tick a cell last moved on. A particle that moves into
+	// a cell the scan has not reached yet is skipped when the scan gets
+	// there. The byte wraps, so a cell resting for a multiple of 256 ticks
+	// is skipped once, which only delays it by a tick.
+	std::vector<uint8_t> stamps;
+	// Fall speed of each cell in 1 / velocityScale cells per tick, 0 at rest
+	std::vector<uint8_t> velocities;
+	// Water in each cell, 1 in a full cell. Only the mass model has anything
+	// but whole cells, the other keeps it at 1 for water and 0 elsewhere.
+	std::vector<float> masses;
+	// Which cells are not empty, for skipping empty space a word at a time
+	OccupancyMap occupancy;
+
+	// The world is split into chunks that sleep while nothing in them moves
+	static constexpr int chunkSize = 64;
+	// How far around a changed cell neighbours are woken up
+	static constexpr int wakeMargin = 2;
+	// The furthest any update writes from the cell being processed. Chunks
+	// are processed in four checkerboard phases, and keeping the reach under
+	// half a chunk means two chunks of the same phase never touch one cell.
+	static constexpr int maxReach = 4;
+	static_assert(maxReach * 2 < chunkSize, "updates must not reach across half a chunk");
+	// The furthest an update reads along a row. The nearest other chunk of
+	// the same phase is a whole chunk away, and its updates write no more
+	// than maxReach outside it.
+	static constexpr int maxScan = chunkSize - 2 * maxReach;
+	static_assert(chunkSize % OccupancyMap::wordBits == 0, "chunks must cover whole occupancy words");
+
+	// Falling speeds up by gravity every tick until it reaches the terminal
+	// velocity, which is as far as a cell may move in one tick
+	static constexpr int velocityScale = 4;
+	static constexpr int gravity = 1;
+	static constexpr int terminalVelocity = maxReach * velocityScale;
+	static_assert(terminalVelocity <= UINT8_MAX, "velocities are stored in a byte");
+
+	//*** Flight, see flight.cpp
+	// Cells out of the grid and in the air
+	FlyingParticles flying;
+	// Cells launched during a tick, one list per chunk so workers never
+	// share one. They join flying in chunk order, whatever the thread count.
+	std::vector<FlyingParticles> launches;
+	// Cells covered by flying particles before and after the last tick
+	int flightMinX = INT_MAX, flightMinY = INT_MAX;
+	int flightMaxX = INT_MIN, flightMaxY = INT_MIN;
+	// Cells per tick, and a falling cell this fast splashes the liquid it lands in
+	static constexpr float flightGravity = float(gravity) / velocityScale;
+	static constexpr float maxFlightSpeed = 8.0f;
+	static constexpr int splashVelocity = 3 * velocityScale;
+
+	//*** Mass water, see fluid.cpp
+	WaterModel waterModel = WaterModel::Cells;
+	// The material the cell kernels leave to the fluid solver, Empty for none
+	uint8_t massMaterial = MaterialId::Empty;
+	// What each cell gives to its neighbour below, left, right and above
+	// during a tick. The flows are worked out from the masses and then
+	// applied to them, so neither pass reads what it writes.
+	std::vector<float> flowDown, flowLeft, flowRight, flowUp;
+	// Per chunk, 1 if its water flows this tick
+	std::vector<uint8_t> fluidChunks;
+	// A full cell, how much more a cell holds per full cell above it, and
+	// the least a cell holds and still counts as water
+	static constexpr float maxMass = 1.0f;
+	static constexpr float maxCompress = 0.02f;
+	static constexpr float minMass = 0.005f;
+	// Flows up or down above minFlow are halved to damp them, and none is
+	// more than maxFlow. Flows under leastFlow do not happen at all, so
+	// the levels come to rest instead of trading ever smaller amounts.
+	static constexpr float minFlow = 0.01f;
+	static constexpr float maxFlow = 1.0f;
+	static constexpr float leastFlow = 0.0001f;
+	// A cell whose mass changes by less than this leaves its chunk asleep
+	static constexpr float settleMass = 0.001f;
+
+	//*** Heat, see heat.cpp
+	// Temperature of each block of heatBlock x heatBlock cells, heatWidth by
+	// heatHeight blocks in rows, and that of the coming tick being worked out
+	static constexpr int heatBlock = 4;
+	static_assert(chunkSize % heatBlock == 0, "chunks must cover whole heat blocks");
+	int heatWidth = 0;
+	int heatHeight = 0;
+	std::vector<float> temperatures, nextTemperatures;
+	// Mean conductivity of each block's cells, their mean glow, and the mean
+	// of glow times temperature, as of the last tick the block's heat flowed
+	std::vector<float> conductivities, glows, glowHeats;
+	// The lowest hotAt and highest coldAt of the materials in each block.
+	// Between the two no cell of the block changes, so its cells are left
+	// unread while they stay the same.
+	std::vector<float> hotLimits, coldLimits;
+	// Per chunk, 1 if its heat flows this tick, and the chunk rows holding any
+	std::vector<uint8_t> heatChunks;
+	std::vector<int> heatRows;
+	// Per chunk, the four bounds of the cells that may have changed since
+	// the last tick, taken before any block settles
+	std::vector<int> heatChanged;
+	// Share of the difference between two blocks of full conductivity that
+	// crosses between them in a tick, no more than a quarter or the field
+	// overshoots, and share of its difference from the ambient temperature
+	// every block loses in a tick
+	static constexpr float heatRate = 0.2f;
+	static constexpr float ambientRate = 0.001f;
+	// A block whose temperature changes by less than this leaves its chunk asleep
+	static constexpr float settleHeat = 0.05f;
+	// A cell past one of its material's limits changes with odds of 1 in
+	// this a tick, so a block does not change all at once
+	static constexpr int phaseOdds = 8;
+
+	//*** Gas
+	// Gas cells met by the bottom row first scan of each chunk, which are
+	// updated top row first once the scan is done, as they rise. One list
+	// per chunk so workers never share one.
+	std::vector<std::vector<olc::vi2d>> risingCells;
+	// Per chunk, 1 if it may hold cells with a lifetime: it held some when it
+	// last faded, or has been awake since. Each chunk fades once every
+	// fadePeriod ticks, a few chunks a tick, and its cells vanish with odds
+	// of fadePeriod in their lifetime, so none is looked at every tick.
+	std::vector<uint8_t> fadingChunks;
+	std::vector<int> fadeChunks;
+	static constexpr int fadePeriod = 32;
+
+	int chunksX = 0;
+	int chunksY = 0;
+	std::vector<Chunk> chunks;
+	std::vector<int> phaseChunks;
+	ThreadPool threadPool;
+
+	uint64_t worldSeed = 0;
+	uint64_t tick = 0;
+	MaterialRegistry registry;
+
+	// Stream for work done outside the tick, such as placing objects
+	Random mainRandom;
+	std::vector<Emitter> emitters;
+	TickStats tickStats;
+
+	//*** Streaming, see streaming.cpp
+	ChunkStore* chunkStore = nullptr;
+	// Cell of the unbounded world at cell (0, 0) of the planes
+	olc::vi2d origin = { 0, 0 };
+	// Chunks kept between the followed area and the edge of the planes, and
+	// prefetched beyond that edge
+	static constexpr int streamMargin = 2;
+
+public:
+	// Updates on every hardware thread unless told otherwise
+	Simulation()
+	{
+		SetThreadCount(int(std::thread::hardware_concurrency()));
 	}
 
+	int GetWidth() const { return worldWidth; }
+	int GetHeight() const { return worldHeight; }
+	static int GetChunkSize() { return chunkSize; }
+	int Index(int x, int y) const { return y * worldWidth + x; }
+	uint8_t GetMaterial(int x, int y) const { return materials[Index(x, y)]; }
+	olc::Pixel GetColor(int x, int y) const { return colors[Index(x, y)]; }
+	// The color plane, row-major and black where the world is empty, so it
+	// can be displayed as it is
+	olc::Pixel* GetColorData() { return colors.data(); }
+	// Adds the cells that may have changed color during the last tick,
+	// for uploading only those to the GPU
+	void CollectDirtyRegion(olc::DirtyRegion& region) const;
+	// Draws the screen pixels in region of what the camera sees into view,
+	// an image of camera.width by camera.height. Outside the world is black.
+	void DrawView(const Camera& camera, olc::Pixel* view, const olc::DirtyRegion& region) const;
+	bool IsEmpty(int x, int y) const { return materials[Index(x, y)] == 0; }
+	bool InBounds(int x, int y) const { return x >= 0 && x < worldWidth && y >= 0 && y < worldHeight; }
+	int GetAwakeChunkCount() const;
+
+	// Number of threads updating the world, 1 runs every chunk on the caller
+	void SetThreadCount(int count) { threadPool.SetThreadCount(std::max(count, 1)); }
+	int GetThreadCount() const { return threadPool.GetThreadCount(); }
+
+	// The same seed and the same inputs reproduce the same world,
+	// whatever the thread count
+	void SetSeed(uint64_t seed);
+	uint64_t GetSeed() const { return worldSeed; }
+	uint64_t GetTick() const { return tick; }
+	Random& GetRandom() { return mainRandom; }
+	const TickStats& GetTickStats() const { return tickStats; }
+	MaterialRegistry& GetMaterials() { return registry; }
 
 	//void DrawSimulation();
-	void CreateObject(int x, int y, int objectType);
-	void InitSimulation(int screen_w, int screen_h, int pixel_w = 1, int pixel_h = 1);
+	void CreateObject(int x, int y, uint8_t material);
+	void InitSimulation(int width, int height);
 	void ProcessSimulation();
-};
 
+	// Writes the whole world to a versioned binary file: the cell planes,
+	// chunk rectangles, emitters, seed, tick and random state. Compressed
+	// snapshots run-length encode the planes. Uncompressed ones load by
+	// mapping the file and copying each plane as it is.
+	bool SaveSnapshot(const std::string& path, bool compress = true) const;
+	// Replaces the world with a snapshot, resizing it if needed. On failure
+	// the world is left as it was.
+	bool LoadSnapshot(const std::string& path);
+	// Digest of the cell planes, emitters and tick. Two runs from the same
+	// seed and inputs end with the same hash.
+	uint64_t Hash() const;
+
+	// Brushes write whole shapes straight into the world planes, clipping
+	// once per shape. Material only lands in empty cells, except Empty
+	// itself, which erases. Density is the fraction of covered cells that
+	// receive material, 1 fills every one of them.
+	void FillRect(int x, int y, int w, int h, uint8_t material, float density = 1.0f);
+	void FillCircle(int cx, int cy, int radius, uint8_t material, float density = 1.0f);
+	// A line of the given radius with round ends, e.g. between the previous
+	// and current mouse positions
+	void FillLine(int x0, int y0, int x1, int y1, int radius, uint8_t material, float density = 1.0f);
+	// Scatters count cells uniformly over a circle
+	void Spray(int cx, int cy, int radius, uint8_t material, int count);
+	// Throws the loose cells within radius of (cx, cy) out of the grid, away
+	// from the centre at up to speed cells per tick. Static cells stay put.
+	void Burst(int cx, int cy, int radius, float speed);
+	void Apply(const SimulationCommand& command);
+
+	// Emitters spray their material at the start of every tick
+	int AddEmitter(const Emitter& emitter);
+	void RemoveEmitter(int index);
+	std::vector<Emitter>& GetEmitters() { return emitters; }
+	// Cells thrown out of the grid that have not landed yet
+	const FlyingParticles& GetFlying() const { return flying; }
+
+	// Switches water between whole cells and the mass model. Leaving the
+	// mass model rounds every wet cell up to a full one.
+	void SetWaterModel(WaterModel model);
+	WaterModel GetWaterModel() const { return waterModel; }
+	float GetMass(int x, int y) const { return masses[Index(x, y)]; }
+	// Temperature of the block holding cell (x, y)
+	float GetTemperature(int x, int y) const { return temperatures[HeatIndex(x, y)]; }
+
+	// Makes the world unbounded. The planes become a window onto it that
+	// slides by whole chunks, saving chunks that leave to the store and
+	// loading those that enter from it. Chunks outside the window are frozen
+	// until they come back. The window is rounded up to whole chunks and
+	// filled from the store. Pass nullptr to stop streaming.
+	void SetChunkStore(ChunkStore* store);
+	bool IsStreaming() const { return chunkStore != nullptr; }
+	// Cell coordinates are relative to this cell of the unbounded world,
+	// except in commands, which use world coordinates
+	olc::vi2d GetOrigin() const { return origin; }
+	// Slides the window, if needed, to keep the world cells [x0, x1] x
+	// [y0, y1] well inside it
+	void Follow(int x0, int y0, int x1, int y1);
+	// Saves every chunk of the window to the store, e.g. before exiting.
+	// Cells in flight are not part of any chunk and are not saved.
+	void StoreResident();
+
+private:
+	void WakeCell(int x, int y);
+	void WakeRect(int x0, int y0, int x1, int y1);
+	void FillSpan(int y, int x0, int x1, uint8_t material, uint32_t threshold);
+	void RunEmitters();
+	TickStats ProcessChunk(Chunk& chunk, Random& rng);
+	void FadeCells(uint64_t tickSeed);
+	bool Fall(int x, int y, uint8_t material, Random& rng);
+	int FindOutlet(int x, int y, uint8_t material, int side, bool mustFall) const;
+
+	void Launch(FlyingParticles& list, int x, int y, float vx, float vy);
+	void StepFlight();
+	bool Land(size_t i, int fromX, int fromY);
+	void DrawFlying(const Camera& camera, olc::Pixel* view, const olc::DirtyRegion& region) const;
+
+	int StepFluid(uint64_t tickSeed);
+	void FlowRow(int y, int x0, int x1, float* scratch);
+	bool ApplyFlowRow(int y, int x0, int x1, float* scratch, Random& rng, int& wakeMin, int& wakeMax, int& wetCells);
+	bool IsFlowing(int x, int y) const;
+	void LoadFluidRow(const std::vector<float>& plane, int y, int x0, int x1, float* out) const;
+	void LoadOpenRow(int y, int x0, int x1, float* out) const;
+
+	void StepHeat(uint64_t tickSeed);
+	void DiffuseRow(int by, int bx0, int bx1, float* scratch);
+	void ChangeBlock(int bx, int by, bool changedCells, Random& rng);
+	void MeasureBlock(int bx, int by);
+	bool IsHeating(int bx, int by) const;
+	void LoadHeatRow(const std::vector<float>& plane, int by, int bx0, int bx1, float* out) const;
+
+	// Flags the chunks that are awake and the chunks next to them
+	void FlagAwakeNeighbourhood(std::vector<uint8_t>& flags) const;
+
+	void ShiftWindow(int chunksRight, int chunksDown);
+	void EvictChunk(int cx, int cy);
+	void LoadChunk(int cx, int cy);
+	void PrefetchAround();
+
+	// Update kernel for one movement class, specialised in simulation.cpp
+	template<MovementClass M>
+	void UpdateCell(int x, int y, uint8_t material, Random& rng);
+
+	// True if a cell of the given material may move into (x, y)
+	bool CanEnter(uint8_t material, int x, int y) const
+	{
+		return InBounds(x, y) && registry.CanDisplace(material, materials[Index(x, y)]);
+	}
+
+	// Moves a cell, trading places with whatever lighter material it displaces
+	void Displace(int x, int y, int toX, int toY)
+	{
+		if (materials[Index(toX, toY)] == MaterialId::Empty)
+			MoveCell(x, y, toX, toY);
+		else
+			SwapCells(x, y, toX, toY);
+	}
+
+	uint8_t CurrentStamp() const { return uint8_t(tick); }
+
+	int HeatIndex(int x, int y) const { return (y / heatBlock) * heatWidth + x / heatBlock; }
+
+	// Mixes the temperature of a new cell into its block. Air holds little
+	// heat, so the cell counts for more than its share of the block.
+	void AddHeat(int x, int y, uint8_t material)
+	{
+		float& heat = temperatures[HeatIndex(x, y)];
+		heat += (registry.GetTemperature(material) - heat) * (1.0f / heatBlock);
+	}
+
+	void SetCell(int x, int y, uint8_t material, olc::Pixel color)
+	{
+		// New cells are due for an update on the coming tick
+		SetCell(x, y, material, color, uint8_t(tick - 1));
+		WakeCell(x, y);
+	}
+
+	// Writes every plane of a cell without waking it, for brushes that wake
+	// their whole shape once
+	void SetCell(int x, int y, uint8_t material, olc::Pixel color, uint8_t stamp)
+	{
+		int index = Index(x, y);
+		materials[index] = material;
+		colors[index] = color;
+		stamps[index] = stamp;
+		velocities[index] = 0;
+		masses[index] = material == MaterialId::Water ? 1.0f : 0.0f;
+		occupancy.Assign(x, y, material != MaterialId::Empty);
+	}
+
+	void ClearCell(int x, int y)
+	{
+		int index = Index(x, y);
+		materials[index] = 0;
+		colors[index] = olc::BLACK;
+		velocities[index] = 0;
+		masses[index] = 0.0f;
+		occupancy.Clear(x, y);
+	}
+
+	// Moves every plane of a cell and leaves the source empty
+	void MoveCell(int x, int y, int toX, int toY)
+	{
+		int from = Index(x, y);
+		int to = Index(toX, toY);
+		materials[to] = materials[from];
+		colors[to] = colors[from];
+		stamps[to] = CurrentStamp();
+		velocities[to] = velocities[from];
+		masses[to] = masses[from];
+		occupancy.Set(toX, toY);
+		ClearCell(x, y);
+		WakeCell(x, y);
+		WakeCell(toX, toY);
+	}
+
+	void SwapCells(int x, int y, int otherX, int otherY)
+	{
+		int a = Index(x, y);
+		int b = Index(otherX, otherY);
+		std::swap(materials[a], materials[b]);
+		std::swap(colors[a], colors[b]);
+		std::swap(velocities[a], velocities[b]);
+		std::swap(masses[a], masses[b]);
+		stamps[a] = stamps[b] = CurrentStamp();
+		occupancy.Assign(x, y, materials[a] != MaterialId::Empty);
+		occupancy.Assign(otherX, otherY, materials[b] != MaterialId::Empty);
+		WakeCell(x, y);
+		WakeCell(otherX, otherY);
+	}
+};
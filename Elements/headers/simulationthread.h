@@ -0,0 +1,88 @@
+#pragma once
+#include "simulation.h"
+#include "triplebuffer.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a Simulation at a fixed tick rate on a thread of its own, apart from
+// the engine thread that handles input and draws. Input arrives through a
+// queue and is applied between ticks, and every tick publishes what the
+// camera sees through a triple buffer, so a stalled frame or vsync never
+// slows the simulation and a slow tick never holds up a frame. Frames are
+// the size of the screen whatever the size of the world.
+//
+// Before Start() nothing runs in the background, and Step() advances the
+// world on the caller instead. Replays and benchmarks use that to get
+// exactly one tick per call.
+class SimulationThread
+{
+public:
+	explicit SimulationThread(Simulation& simulation) : simulation(simulation) {}
+	~SimulationThread();
+
+	SimulationThread(const SimulationThread&) = delete;
+	SimulationThread& operator=(const SimulationThread&) = delete;
+
+	// The world must be initialised. Once started, only this thread may
+	// touch the simulation until Stop() returns.
+	void Start(double ticksPerSecond);
+	void Stop();
+	bool IsRunning() const { return running; }
+
+	// Runs one tick on the calling thread, only while stopped
+	void Step();
+
+	// Call after replacing the whole world while stopped, for example by
+	// loading a snapshot, so the next frame carries all of it
+	void Invalidate();
+
+	// Safe to call from any thread
+	void Push(const SimulationCommand& command);
+	// The window the next frames show, in world coordinates. A streaming
+	// world follows it. Safe to call from any thread.
+	void SetCamera(const Camera& camera);
+
+	// Records the parts of each tick as phases of the given profiler. Call
+	// while stopped.
+	void SetProfiler(olc::Profiler* profiler);
+
+	// The newest frame, or nullptr if no tick finished since the last call.
+	// Call from one thread only.
+	Frame* AcquireFrame() { return frames.Acquire(); }
+
+private:
+	// When this many ticks behind, the schedule is reset rather than
+	// running every missed tick back to back
+	static constexpr int maxLagTicks = 5;
+
+	void Run(double ticksPerSecond);
+	void Tick();
+
+	Simulation& simulation;
+	TripleBuffer frames;
+	std::thread thread;
+	std::atomic<bool> running{ false };
+
+	std::mutex inputMutex;
+	std::vector<SimulationCommand> queuedInput;
+	Camera queuedCamera;
+	// Swapped with queuedInput each tick, so applying input holds no lock
+	std::vector<SimulationCommand> tickInput;
+
+	//*** Tick only
+	// The last camera drawn, relative to the simulation's planes
+	Camera camera;
+	// What the camera sees, redrawn where the world changed or in full
+	// when the camera moves
+	std::vector<olc::Pixel> view;
+	bool redrawView = true;
+	olc::DirtyRegion changed;
+	olc::DirtyRegion viewChanged;
+
+	olc::Profiler* profiler = nullptr;
+	uint32_t phaseInput = 0;
+	uint32_t phaseTick = 0;
+	uint32_t phasePublish = 0;
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small fork/join pool for splitting a tick across cores. ParallelFor
+// blocks until every index has been processed, and the calling thread
+// takes part in the work, so a pool of one thread never starts a worker.
+class ThreadPool
+{
+public:
+	ThreadPool() = default;
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Total number of threads working on a job, including the caller
+	void SetThreadCount(int count);
+	int GetThreadCount() const { return int(workers.size()) + 1; }
+
+	// Calls job(index) once for every index in [0, count)
+	void ParallelFor(int count, const std::function<void(int)>& job);
+
+private:
+	void WorkerLoop();
+	void RunJob();
+	void StopWorkers();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+
+	const std::function<void(int)>* job = nullptr;
+	int jobCount = 0;
+	uint64_t generation = 0;
+	int busyWorkers = 0;
+	bool stopping = false;
+	std::atomic<int> nextIndex{ 0 };
+};
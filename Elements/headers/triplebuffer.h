@@ -0,0 +1,55 @@
+#pragma once
+#include "PixelGameEngine.h"
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// One published image of what the camera sees
+struct Frame
+{
+	std::vector<olc::Pixel> pixels;
+	// Pixels that differ from the frame the reader took before this one
+	olc::DirtyRegion changed;
+	uint64_t tick = 0;
+};
+
+// Hands frames from the simulation thread to the render thread. There is
+// always a free slot to write and always a complete frame to read, so
+// neither side waits on the other, and a frame the reader never took is
+// simply replaced by the next one. The lock only guards swapping indices.
+class TripleBuffer
+{
+public:
+	void Reset(int width, int height);
+	bool Matches(int width, int height) const { return width == frameWidth && height == frameHeight; }
+
+	// Writer: brings the free slot up to date with the source image, given
+	// the pixels changed since the last call, and makes it the newest frame
+	void Publish(const olc::Pixel* source, const olc::DirtyRegion& changed, uint64_t tick);
+
+	// Reader: the newest frame, or nullptr if none was published since the
+	// last call. The frame stays valid until the next call.
+	Frame* Acquire();
+
+private:
+	int frameWidth = 0;
+	int frameHeight = 0;
+	std::array<Frame, 3> frames;
+
+	//*** Writer only
+	// Pixels of each slot that are behind the source. Copying only these
+	// keeps a publish proportional to what moved, not to the frame size.
+	std::array<olc::DirtyRegion, 3> stale;
+	// Changes to report with the next frame on top of the tick's own
+	olc::DirtyRegion pending;
+	int writeSlot = 0;
+
+	//*** Shared, guarded by mutex
+	std::mutex mutex;
+	int readySlot = 1;
+	bool fresh = false;
+
+	//*** Reader only
+	int readSlot = 2;
+};
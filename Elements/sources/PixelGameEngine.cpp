@@ -63,6 +63,281 @@ namespace olc
 		return Pixel(uint8_t(red * 255.0f), uint8_t(green * 255.0f), uint8_t(blue * 255.0f), uint8_t(alpha * 255.0f));
 	}
 
+	// O------------------------------------------------------------------------------O
+	// | olc::DirtyRegion IMPLEMENTATION                                              |
+	// O------------------------------------------------------------------------------O
+	void DirtyRegion::Add(int32_t x, int32_t y, int32_t w, int32_t h)
+	{
+		if (w <= 0 || h <= 0) return;
+		Rect r = { x, y, x + w, y + h };
+
+		// Newest first, consecutive pixel writes usually grow the same rectangle
+		for (auto e = vRects.rbegin(); e != vRects.rend(); ++e)
+		{
+			if (r.x0 <= e->x1 && r.x1 >= e->x0 && r.y0 <= e->y1 && r.y1 >= e->y0)
+			{
+				e->x0 = std::min(e->x0, r.x0); e->y0 = std::min(e->y0, r.y0);
+				e->x1 = std::max(e->x1, r.x1); e->y1 = std::max(e->y1, r.y1);
+				return;
+			}
+		}
+
+		vRects.push_back(r);
+		if (vRects.size() > nMaxRects)
+		{
+			Rect bounds = vRects[0];
+			for (const auto& e : vRects)
+			{
+				bounds.x0 = std::min(bounds.x0, e.x0); bounds.y0 = std::min(bounds.y0, e.y0);
+				bounds.x1 = std::max(bounds.x1, e.x1); bounds.y1 = std::max(bounds.y1, e.y1);
+			}
+			vRects.assign(1, bounds);
+		}
+	}
+
+	void DirtyRegion::Add(const DirtyRegion& other)
+	{
+		for (const auto& r : other.vRects)
+			Add(r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0);
+	}
+
+	void DirtyRegion::Clip(int32_t w, int32_t h)
+	{
+		for (auto& r : vRects)
+		{
+			r.x0 = std::max(r.x0, 0); r.y0 = std::max(r.y0, 0);
+			r.x1 = std::min(r.x1, w); r.y1 = std::min(r.y1, h);
+		}
+		vRects.erase(std::remove_if(vRects.begin(), vRects.end(),
+			[](const Rect& r) { return r.x0 >= r.x1 || r.y0 >= r.y1; }), vRects.end());
+	}
+
+	void DirtyRegion::Clear()
+	{
+		vRects.clear();
+	}
+
+	bool DirtyRegion::Empty() const
+	{
+		return vRects.empty();
+	}
+
+	// O------------------------------------------------------------------------------O
+	// | olc::Profiler IMPLEMENTATION                                                 |
+	// O------------------------------------------------------------------------------O
+	uint32_t Profiler::AddPhase(const std::string& sName)
+	{
+		uint32_t nCount = nPhaseCount.load();
+		for (uint32_t i = 0; i < nCount; i++)
+			if (vPhases[i].sName == sName) return i;
+
+		if (nCount == nMaxPhases) return nMaxPhases - 1;
+		vPhases[nCount].sName = sName;
+		nPhaseCount.store(nCount + 1);
+		return nCount;
+	}
+
+	uint32_t Profiler::GetPhaseCount() const
+	{
+		return nPhaseCount.load();
+	}
+
+	const std::string& Profiler::GetPhaseName(uint32_t nPhase) const
+	{
+		return vPhases[nPhase].sName;
+	}
+
+	void Profiler::Record(uint32_t nPhase, float fMs)
+	{
+		// Each writer claims its own slot, so concurrent writers never meet
+		// unless one laps the whole ring
+		Ring& ring = vPhases[nPhase];
+		uint32_t nSlot = ring.nNext.fetch_add(1, std::memory_order_relaxed);
+		ring.fSamples[nSlot % nHistory].store(fMs, std::memory_order_relaxed);
+	}
+
+	void Profiler::Record(uint32_t nPhase, Clock::time_point tpStart)
+	{
+		Record(nPhase, std::chrono::duration<float, std::milli>(Clock::now() - tpStart).count());
+	}
+
+	Profiler::Stats Profiler::GetStats(uint32_t nPhase) const
+	{
+		const Ring& ring = vPhases[nPhase];
+		uint32_t nCount = std::min<uint32_t>(ring.nNext.load(std::memory_order_relaxed), nHistory);
+
+		std::array<float, nHistory> fSorted;
+		float fSum = 0.0f;
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			fSorted[i] = ring.fSamples[i].load(std::memory_order_relaxed);
+			fSum += fSorted[i];
+		}
+
+		Stats stats;
+		stats.nSamples = nCount;
+		if (nCount == 0) return stats;
+
+		uint32_t nP99 = (nCount * 99) / 100;
+		std::nth_element(fSorted.begin(), fSorted.begin() + nP99, fSorted.begin() + nCount);
+		stats.fAverageMs = fSum / float(nCount);
+		stats.fP99Ms = fSorted[nP99];
+		return stats;
+	}
+
+	// O------------------------------------------------------------------------------O
+	// | olc::Trace IMPLEMENTATION                                                    |
+	// O------------------------------------------------------------------------------O
+	std::atomic<bool> Trace::bRecording{ false };
+	std::unique_ptr<Trace::Event[]> Trace::pEvents;
+	size_t Trace::nCapacity = 0;
+	std::atomic<size_t> Trace::nNextEvent{ 0 };
+	Trace::Clock::time_point Trace::tpOrigin;
+	std::mutex Trace::muxThreadNames;
+	std::map<uint32_t, std::string> Trace::mapThreadNames;
+
+	void Trace::Start(size_t nMaxEvents)
+	{
+		if (bRecording) return;
+
+		// The buffer is only ever grown, a thread that was still finishing
+		// an event of the last recording never writes into freed memory
+		if (nMaxEvents > nCapacity)
+		{
+			pEvents.reset(new Event[nMaxEvents]);
+			nCapacity = nMaxEvents;
+		}
+		for (size_t i = 0; i < nCapacity; i++)
+			pEvents[i].bReady.store(false, std::memory_order_relaxed);
+
+		nNextEvent = 0;
+		tpOrigin = Clock::now();
+		bRecording.store(true, std::memory_order_release);
+	}
+
+	void Trace::Stop()
+	{
+		bRecording.store(false, std::memory_order_release);
+	}
+
+	uint32_t Trace::ThreadId()
+	{
+		static std::atomic<uint32_t> nNextThread{ 1 };
+		thread_local uint32_t nThread = nNextThread++;
+		return nThread;
+	}
+
+	void Trace::SetThreadName(const std::string& sName)
+	{
+		std::lock_guard<std::mutex> lock(muxThreadNames);
+		mapThreadNames[ThreadId()] = sName;
+	}
+
+	void Trace::Record(const char* sName, int32_t nArg, Clock::time_point tpStart, Clock::time_point tpEnd)
+	{
+		if (!bRecording.load(std::memory_order_acquire)) return;
+
+		size_t nEvent = nNextEvent.fetch_add(1, std::memory_order_relaxed);
+		if (nEvent >= nCapacity) return;
+
+		Event& e = pEvents[nEvent];
+		e.sName = sName;
+		e.nArg = nArg;
+		e.nThread = ThreadId();
+		e.nStartNs = std::chrono::duration_cast<std::chrono::nanoseconds>(tpStart - tpOrigin).count();
+		e.nDurationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(tpEnd - tpStart).count();
+		e.bReady.store(true, std::memory_order_release);
+	}
+
+	olc::rcode Trace::Save(const std::string& sFile)
+	{
+		std::ofstream file(sFile);
+		if (!file.is_open()) return olc::FAIL;
+
+		size_t nRecorded = std::min(nNextEvent.load(), nCapacity);
+		size_t nDropped = nNextEvent.load() - nRecorded;
+
+		// Complete ("X") events, timestamps in microseconds
+		file << "{\"traceEvents\":[\n";
+		bool bFirst = true;
+		{
+			std::lock_guard<std::mutex> lock(muxThreadNames);
+			for (const auto& name : mapThreadNames)
+			{
+				file << (bFirst ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << name.first
+					<< ",\"args\":{\"name\":\"" << name.second << "\"}}";
+				bFirst = false;
+			}
+		}
+
+		char sLine[256];
+		for (size_t i = 0; i < nRecorded; i++)
+		{
+			const Event& e = pEvents[i];
+			if (!e.bReady.load(std::memory_order_acquire)) continue;
+
+			int n = snprintf(sLine, sizeof(sLine), "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+				e.sName, e.nThread, double(e.nStartNs) / 1000.0, double(e.nDurationNs) / 1000.0);
+			if (e.nArg >= 0 && n > 0 && size_t(n) < sizeof(sLine))
+				snprintf(sLine + n, sizeof(sLine) - n, ",\"args\":{\"index\":%d}", e.nArg);
+			file << (bFirst ? "" : ",\n") << sLine << "}";
+			bFirst = false;
+		}
+
+		file << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << nDropped << "}}\n";
+		return file.good() ? olc::OK : olc::FAIL;
+	}
+
+	// O------------------------------------------------------------------------------O
+	// | olc::InputRecording IMPLEMENTATION                                           |
+	// O------------------------------------------------------------------------------O
+	namespace
+	{
+		constexpr char sInputMagic[8] = { 'O', 'L', 'C', 'I', 'N', 'P', 'U', 'T' };
+		constexpr uint32_t nInputVersion = 1;
+	}
+
+	olc::rcode InputRecording::Save(const std::string& sFile) const
+	{
+		std::ofstream file(sFile, std::ofstream::binary);
+		if (!file.is_open()) return olc::FAIL;
+
+		uint64_t nFrames = vFrames.size();
+		file.write(sInputMagic, sizeof(sInputMagic));
+		file.write((const char*)&nInputVersion, sizeof(nInputVersion));
+		file.write((const char*)&nSeed, sizeof(nSeed));
+		file.write((const char*)&nFrames, sizeof(nFrames));
+		file.write((const char*)vFrames.data(), std::streamsize(nFrames * sizeof(Frame)));
+		return file.good() ? olc::OK : olc::FAIL;
+	}
+
+	olc::rcode InputRecording::Load(const std::string& sFile)
+	{
+		std::ifstream file(sFile, std::ifstream::binary);
+		if (!file.is_open()) return olc::NO_FILE;
+
+		char sMagic[sizeof(sInputMagic)];
+		uint32_t nVersion = 0;
+		uint64_t nFrames = 0;
+		file.read(sMagic, sizeof(sMagic));
+		file.read((char*)&nVersion, sizeof(nVersion));
+		file.read((char*)&nSeed, sizeof(nSeed));
+		file.read((char*)&nFrames, sizeof(nFrames));
+		if (!file.good() || memcmp(sMagic, sInputMagic, sizeof(sMagic)) != 0 || nVersion != nInputVersion)
+			return olc::FAIL;
+
+		// Check the frame count against the file before trusting it
+		std::streamoff nHeader = file.tellg();
+		file.seekg(0, std::ios::end);
+		if (uint64_t(file.tellg() - nHeader) != nFrames * sizeof(Frame))
+			return olc::FAIL;
+		file.seekg(nHeader);
+
+		vFrames.resize(size_t(nFrames));
+		file.read((char*)vFrames.data(), std::streamsize(nFrames * sizeof(Frame)));
+		return file.good() ? olc::OK : olc::FAIL;
+	}
+
 	// O------------------------------------------------------------------------------O
 	// | olc::Sprite IMPLEMENTATION                                                   |
 	// O------------------------------------------------------------------------------O
@@ -85,20 +360,28 @@ namespace olc
 			pColData[i] = Pixel();
 	}
 
+	Sprite::Sprite(int32_t w, int32_t h, Pixel* pData)
+	{
+		width = w;		height = h;
+		pColData = pData;
+		bOwnsData = false;
+	}
+
 	Sprite::~Sprite()
 	{
-		if (pColData) delete[] pColData;
+		if (pColData && bOwnsData) delete[] pColData;
 	}
 
 
 	olc::rcode Sprite::LoadFromPGESprFile(const std::string& sImageFile, olc::ResourcePack* pack)
 	{
-		if (pColData) delete[] pColData;
+		if (pColData && bOwnsData) delete[] pColData;
 		auto ReadData = [&](std::istream& is)
 		{
 			is.read((char*)&width, sizeof(int32_t));
 			is.read((char*)&height, sizeof(int32_t));
 			pColData = new Pixel[width * height];
+			bOwnsData = true;
 			is.read((char*)pColData, (size_t)width * (size_t)height * sizeof(uint32_t));
 		};
 
@@ -219,6 +502,34 @@ namespace olc
 		return pColData;
 	}
 
+	void Sprite::SetExternalData(Pixel* pData)
+	{
+		if (pData == pColData) return;
+		if (pColData && bOwnsData) delete[] pColData;
+
+		if (pData)
+		{
+			pColData = pData;
+			bOwnsData = false;
+		}
+		else
+		{
+			pColData = new Pixel[width * height];
+			bOwnsData = true;
+		}
+		MarkDirty(0, 0, width, height);
+	}
+
+	bool Sprite::OwnsData() const
+	{
+		return bOwnsData;
+	}
+
+	void Sprite::MarkDirty(int32_t x, int32_t y, int32_t w, int32_t h)
+	{
+		dirty.Add(x, y, w, h);
+	}
+
 
 	// O------------------------------------------------------------------------------O
 	// | olc::Decal IMPLEMENTATION                                                   |
@@ -238,6 +549,23 @@ namespace olc
 		vUVScale = { 1.0f / float(sprite->width), 1.0f / float(sprite->height) };
 		renderer->ApplyTexture(id);
 		renderer->UpdateTexture(id, sprite);
+		sprite->dirty.Clear();
+		dirty.Clear();
+	}
+
+	void Decal::UpdateDirty()
+	{
+		if (sprite == nullptr) return;
+		dirty.Add(sprite->dirty);
+		sprite->dirty.Clear();
+		dirty.Clip(sprite->width, sprite->height);
+		if (!dirty.Empty())
+		{
+			vUVScale = { 1.0f / float(sprite->width), 1.0f / float(sprite->height) };
+			renderer->ApplyTexture(id);
+			renderer->UpdateTextureRegion(id, sprite, dirty);
+			dirty.Clear();
+		}
 	}
 
 	Decal::~Decal()
@@ -475,12 +803,19 @@ namespace olc
 		// Bring in relevant Platform & Rendering systems depending
 		// on compiler parameters
 		olc_ConfigureSystem();
+
+		nPhaseInput = profiler.AddPhase("Input");
+		nPhaseUserUpdate = profiler.AddPhase("OnUserUpdate");
+		nPhaseUpload = profiler.AddPhase("Upload");
+		nPhaseLayers = profiler.AddPhase("Layers");
+		nPhaseDecals = profiler.AddPhase("Decals");
+		nPhasePresent = profiler.AddPhase("Present");
 	}
 
 	PixelGameEngine::~PixelGameEngine() {}
 
 
-	olc::rcode PixelGameEngine::Construct(int32_t screen_w, int32_t screen_h, int32_t pixel_w, int32_t pixel_h, bool full_screen, bool vsync)
+	olc::rcode PixelGameEngine::Construct(int32_t screen_w, int32_t screen_h, int32_t pixel_w, int32_t pixel_h, bool full_screen, bool vsync, bool headless)
 	{
 		vScreenSize = { screen_w, screen_h };
 		vInvScreenSize = { 1.0f / float(screen_w), 1.0f / float(screen_h) };
@@ -493,6 +828,8 @@ namespace olc
 		if (vPixelSize.x <= 0 || vPixelSize.y <= 0 || vScreenSize.x <= 0 || vScreenSize.y <= 0)
 			return olc::FAIL;
 
+		if (headless)
+			olc_ConfigureHeadless();
 
 		return olc::OK;
 	}
@@ -505,6 +842,7 @@ namespace olc
 		{
 			delete layer.pDrawTarget; // Erase existing layer sprites
 			layer.pDrawTarget = new Sprite(vScreenSize.x, vScreenSize.y);
+			layer.dirty.Add(0, 0, vScreenSize.x, vScreenSize.y);
 			layer.bUpdate = true;
 		}
 		SetDrawTarget(nullptr);
@@ -598,6 +936,25 @@ namespace olc
 		if (layer < vLayers.size()) vLayers[layer].funcHook = f;
 	}
 
+	void PixelGameEngine::SetLayerExternalData(uint8_t layer, olc::Pixel* pData, const olc::DirtyRegion* pChanged)
+	{
+		if (layer < vLayers.size())
+		{
+			Sprite* pSprite = vLayers[layer].pDrawTarget;
+			if (pChanged && pData)
+			{
+				// Changes not uploaded yet still apply on top of the new pixels
+				olc::DirtyRegion pending = pSprite->dirty;
+				pSprite->SetExternalData(pData);
+				pSprite->dirty = pending;
+				pSprite->dirty.Add(*pChanged);
+			}
+			else
+				pSprite->SetExternalData(pData);
+			vLayers[layer].bUpdate = true;
+		}
+	}
+
 	std::vector<LayerDesc>& PixelGameEngine::GetLayers()
 	{
 		return vLayers;
@@ -609,6 +966,7 @@ namespace olc
 		ld.pDrawTarget = new olc::Sprite(vScreenSize.x, vScreenSize.y);
 		ld.nResID = renderer->CreateTexture(vScreenSize.x, vScreenSize.y);
 		renderer->UpdateTexture(ld.nResID, ld.pDrawTarget);
+		ld.pDrawTarget->dirty.Clear();
 		vLayers.push_back(ld);
 		return uint32_t(vLayers.size()) - 1;
 	}
@@ -689,6 +1047,53 @@ namespace olc
 		return vWindowSize;
 	}
 
+	olc::Profiler& PixelGameEngine::GetProfiler()
+	{
+		return profiler;
+	}
+
+	void PixelGameEngine::SetFrameLimit(uint32_t frames)
+	{
+		nFrameLimit = frames;
+		nFramesRun = 0;
+	}
+
+	olc::Sprite* PixelGameEngine::GetFrameBuffer() const
+	{
+		return renderer->GetFrameBuffer();
+	}
+
+	void PixelGameEngine::StartInputRecording(uint64_t nSeed)
+	{
+		inputRecording.nSeed = nSeed;
+		inputRecording.vFrames.clear();
+		bRecordingInput = true;
+	}
+
+	olc::rcode PixelGameEngine::SaveInputRecording(const std::string& sFile)
+	{
+		bRecordingInput = false;
+		return inputRecording.Save(sFile);
+	}
+
+	olc::rcode PixelGameEngine::StartInputReplay(const std::string& sFile)
+	{
+		olc::rcode result = inputRecording.Load(sFile);
+		bReplayingInput = result == olc::OK;
+		nReplayFrame = 0;
+		return result;
+	}
+
+	bool PixelGameEngine::IsReplayingInput() const
+	{
+		return bReplayingInput;
+	}
+
+	uint64_t PixelGameEngine::GetInputSeed() const
+	{
+		return inputRecording.nSeed;
+	}
+
 	const olc::vi2d& PixelGameEngine::GetWindowMouse() const
 	{
 		return vMouseWindowPos;
@@ -710,8 +1115,20 @@ namespace olc
 		return Draw(pos.x, pos.y, p);
 	}
 
-	// This is it, the critical function that plots a pixel
 	bool PixelGameEngine::Draw(int32_t x, int32_t y, Pixel p)
+	{
+		if (!Plot(x, y, p)) return false;
+		pDrawTarget->MarkDirty(x, y, 1, 1);
+		return true;
+	}
+
+	void PixelGameEngine::MarkDrawn(int32_t x, int32_t y, int32_t w, int32_t h)
+	{
+		if (pDrawTarget) pDrawTarget->MarkDirty(x, y, w, h);
+	}
+
+	// This is it, the critical function that plots a pixel
+	bool PixelGameEngine::Plot(int32_t x, int32_t y, Pixel p)
 	{
 		if (!pDrawTarget) return false;
 
@@ -760,6 +1177,7 @@ namespace olc
 	{
 		int x, y, dx, dy, dx1, dy1, px, py, xe, ye, i;
 		dx = x2 - x1; dy = y2 - y1;
+		MarkDrawn(std::min(x1, x2), std::min(y1, y2), abs(dx) + 1, abs(dy) + 1);
 
 		auto rol = [&](void) { pattern = (pattern << 1) | (pattern >> 31); return pattern & 1; };
 
@@ -767,14 +1185,14 @@ namespace olc
 		if (dx == 0) // Line is vertical
 		{
 			if (y2 < y1) std::swap(y1, y2);
-			for (y = y1; y <= y2; y++) if (rol()) Draw(x1, y, p);
+			for (y = y1; y <= y2; y++) if (rol()) Plot(x1, y, p);
 			return;
 		}
 
 		if (dy == 0) // Line is horizontal
 		{
 			if (x2 < x1) std::swap(x1, x2);
-			for (x = x1; x <= x2; x++) if (rol()) Draw(x, y1, p);
+			for (x = x1; x <= x2; x++) if (rol()) Plot(x, y1, p);
 			return;
 		}
 
@@ -792,7 +1210,7 @@ namespace olc
 				x = x2; y = y2; xe = x1;
 			}
 
-			if (rol()) Draw(x, y, p);
+			if (rol()) Plot(x, y, p);
 
 			for (i = 0; x < xe; i++)
 			{
@@ -804,7 +1222,7 @@ namespace olc
 					if ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) y = y + 1; else y = y - 1;
 					px = px + 2 * (dy1 - dx1);
 				}
-				if (rol()) Draw(x, y, p);
+				if (rol()) Plot(x, y, p);
 			}
 		}
 		else
@@ -818,7 +1236,7 @@ namespace olc
 				x = x2; y = y2; ye = y1;
 			}
 
-			if (rol()) Draw(x, y, p);
+			if (rol()) Plot(x, y, p);
 
 			for (i = 0; y < ye; i++)
 			{
@@ -830,7 +1248,7 @@ namespace olc
 					if ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) x = x + 1; else x = x - 1;
 					py = py + 2 * (dx1 - dy1);
 				}
-				if (rol()) Draw(x, y, p);
+				if (rol()) Plot(x, y, p);
 			}
 		}
 	}
@@ -844,6 +1262,7 @@ namespace olc
 	{ // Thanks to IanM-Matrix1 #PR121
 		if (radius < 0 || x < -radius || y < -radius || x - GetDrawTargetWidth() > radius || y - GetDrawTargetHeight() > radius)
 			return;
+		MarkDrawn(x - radius, y - radius, 2 * radius + 1, 2 * radius + 1);
 
 		if (radius > 0)
 		{
@@ -854,16 +1273,16 @@ namespace olc
 			while (y0 >= x0) // only formulate 1/8 of circle
 			{
 				// Draw even octants
-				if (mask & 0x01) Draw(x + x0, y - y0, p);// Q6 - upper right right
-				if (mask & 0x04) Draw(x + y0, y + x0, p);// Q4 - lower lower right
-				if (mask & 0x10) Draw(x - x0, y + y0, p);// Q2 - lower left left
-				if (mask & 0x40) Draw(x - y0, y - x0, p);// Q0 - upper upper left
+				if (mask & 0x01) Plot(x + x0, y - y0, p);// Q6 - upper right right
+				if (mask & 0x04) Plot(x + y0, y + x0, p);// Q4 - lower lower right
+				if (mask & 0x10) Plot(x - x0, y + y0, p);// Q2 - lower left left
+				if (mask & 0x40) Plot(x - y0, y - x0, p);// Q0 - upper upper left
 				if (x0 != 0 && x0 != y0)
 				{
-					if (mask & 0x02) Draw(x + y0, y - x0, p);// Q7 - upper upper right
-					if (mask & 0x08) Draw(x + x0, y + y0, p);// Q5 - lower right right
-					if (mask & 0x20) Draw(x - y0, y + x0, p);// Q3 - lower lower left
-					if (mask & 0x80) Draw(x - x0, y - y0, p);// Q1 - upper left left
+					if (mask & 0x02) Plot(x + y0, y - x0, p);// Q7 - upper upper right
+					if (mask & 0x08) Plot(x + x0, y + y0, p);// Q5 - lower right right
+					if (mask & 0x20) Plot(x - y0, y + x0, p);// Q3 - lower lower left
+					if (mask & 0x80) Plot(x - x0, y - y0, p);// Q1 - upper left left
 				}
 
 				if (d < 0)
@@ -873,7 +1292,7 @@ namespace olc
 			}
 		}
 		else
-			Draw(x, y, p);
+			Plot(x, y, p);
 	}
 
 	void PixelGameEngine::FillCircle(const olc::vi2d& pos, int32_t radius, Pixel p)
@@ -885,6 +1304,7 @@ namespace olc
 	{ // Thanks to IanM-Matrix1 #PR121
 		if (radius < 0 || x < -radius || y < -radius || x - GetDrawTargetWidth() > radius || y - GetDrawTargetHeight() > radius)
 			return;
+		MarkDrawn(x - radius, y - radius, 2 * radius + 1, 2 * radius + 1);
 
 		if (radius > 0)
 		{
@@ -895,7 +1315,7 @@ namespace olc
 			auto drawline = [&](int sx, int ex, int y)
 			{
 				for (int x = sx; x <= ex; x++)
-					Draw(x, y, p);
+					Plot(x, y, p);
 			};
 
 			while (y0 >= x0)
@@ -917,7 +1337,7 @@ namespace olc
 			}
 		}
 		else
-			Draw(x, y, p);
+			Plot(x, y, p);
 	}
 
 	void PixelGameEngine::DrawRect(const olc::vi2d& pos, const olc::vi2d& size, Pixel p)
@@ -938,6 +1358,7 @@ namespace olc
 		int pixels = GetDrawTargetWidth() * GetDrawTargetHeight();
 		Pixel* m = GetDrawTarget()->GetData();
 		for (int i = 0; i < pixels; i++) m[i] = p;
+		GetDrawTarget()->MarkDirty(0, 0, GetDrawTargetWidth(), GetDrawTargetHeight());
 	}
 
 	void PixelGameEngine::ClearBuffer(Pixel p, bool bDepth)
@@ -965,9 +1386,10 @@ namespace olc
 		if (y2 < 0) y2 = 0;
 		if (y2 >= (int32_t)GetDrawTargetHeight()) y2 = (int32_t)GetDrawTargetHeight();
 
+		MarkDrawn(x, y, x2 - x, y2 - y);
 		for (int i = x; i < x2; i++)
 			for (int j = y; j < y2; j++)
-				Draw(i, j, p);
+				Plot(i, j, p);
 	}
 
 	void PixelGameEngine::DrawTriangle(const olc::vi2d& pos1, const olc::vi2d& pos2, const olc::vi2d& pos3, Pixel p)
@@ -990,7 +1412,9 @@ namespace olc
 	// https://www.avrfreaks.net/sites/default/files/triangles.c
 	void PixelGameEngine::FillTriangle(int32_t x1, int32_t y1, int32_t x2, int32_t y2, int32_t x3, int32_t y3, Pixel p)
 	{
-		auto drawline = [&](int sx, int ex, int ny) { for (int i = sx; i <= ex; i++) Draw(i, ny, p); };
+		auto drawline = [&](int sx, int ex, int ny) { for (int i = sx; i <= ex; i++) Plot(i, ny, p); };
+		int32_t left = std::min({ x1, x2, x3 }), top = std::min({ y1, y2, y3 });
+		MarkDrawn(left, top, std::max({ x1, x2, x3 }) - left + 1, std::max({ y1, y2, y3 }) - top + 1);
 
 		int t1x, t2x, y, minx, maxx, t1xp, t2xp;
 		bool changed1 = false;
@@ -1138,6 +1562,7 @@ namespace olc
 		int32_t fys = 0, fym = 1, fy = 0;
 		if (flip & olc::Sprite::Flip::HORIZ) { fxs = sprite->width - 1; fxm = -1; }
 		if (flip & olc::Sprite::Flip::VERT) { fys = sprite->height - 1; fym = -1; }
+		MarkDrawn(x, y, sprite->width * int32_t(scale), sprite->height * int32_t(scale));
 
 		if (scale > 1)
 		{
@@ -1148,7 +1573,7 @@ namespace olc
 				for (int32_t j = 0; j < sprite->height; j++, fy += fym)
 					for (uint32_t is = 0; is < scale; is++)
 						for (uint32_t js = 0; js < scale; js++)
-							Draw(x + (i * scale) + is, y + (j * scale) + js, sprite->GetPixel(fx, fy));
+							Plot(x + (i * scale) + is, y + (j * scale) + js, sprite->GetPixel(fx, fy));
 			}
 		}
 		else
@@ -1158,7 +1583,7 @@ namespace olc
 			{
 				fy = fys;
 				for (int32_t j = 0; j < sprite->height; j++, fy += fym)
-					Draw(x + i, y + j, sprite->GetPixel(fx, fy));
+					Plot(x + i, y + j, sprite->GetPixel(fx, fy));
 			}
 		}
 	}
@@ -1177,6 +1602,7 @@ namespace olc
 		int32_t fys = 0, fym = 1, fy = 0;
 		if (flip & olc::Sprite::Flip::HORIZ) { fxs = w - 1; fxm = -1; }
 		if (flip & olc::Sprite::Flip::VERT) { fys = h - 1; fym = -1; }
+		MarkDrawn(x, y, w * int32_t(scale), h * int32_t(scale));
 
 		if (scale > 1)
 		{
@@ -1187,7 +1613,7 @@ namespace olc
 				for (int32_t j = 0; j < h; j++, fy += fym)
 					for (uint32_t is = 0; is < scale; is++)
 						for (uint32_t js = 0; js < scale; js++)
-							Draw(x + (i * scale) + is, y + (j * scale) + js, sprite->GetPixel(fx + ox, fy + oy));
+							Plot(x + (i * scale) + is, y + (j * scale) + js, sprite->GetPixel(fx + ox, fy + oy));
 			}
 		}
 		else
@@ -1197,7 +1623,7 @@ namespace olc
 			{
 				fy = fys;
 				for (int32_t j = 0; j < h; j++, fy += fym)
-					Draw(x + i, y + j, sprite->GetPixel(fx + ox, fy + oy));
+					Plot(x + i, y + j, sprite->GetPixel(fx + ox, fy + oy));
 			}
 		}
 	}
@@ -1473,6 +1899,7 @@ namespace olc
 	{
 		int32_t sx = 0;
 		int32_t sy = 0;
+		int32_t width = 0;
 		Pixel::Mode m = nPixelMode;
 		// Thanks @tucna, spotted bug with col.ALPHA :P
 		if (col.a != 255)		SetPixelMode(Pixel::ALPHA);
@@ -1495,18 +1922,20 @@ namespace olc
 							if (fontSprite->GetPixel(i + ox * 8, j + oy * 8).r > 0)
 								for (uint32_t is = 0; is < scale; is++)
 									for (uint32_t js = 0; js < scale; js++)
-										Draw(x + sx + (i * scale) + is, y + sy + (j * scale) + js, col);
+										Plot(x + sx + (i * scale) + is, y + sy + (j * scale) + js, col);
 				}
 				else
 				{
 					for (uint32_t i = 0; i < 8; i++)
 						for (uint32_t j = 0; j < 8; j++)
 							if (fontSprite->GetPixel(i + ox * 8, j + oy * 8).r > 0)
-								Draw(x + sx + i, y + sy + j, col);
+								Plot(x + sx + i, y + sy + j, col);
 				}
 				sx += 8 * scale;
+				width = std::max(width, sx);
 			}
 		}
+		MarkDrawn(x, y, width, sy + 8 * int32_t(scale));
 		SetPixelMode(m);
 	}
 
@@ -1629,6 +2058,7 @@ namespace olc
 		// Allow platform to do stuff here if needed, since its now in the
 		// context of this thread
 		if (platform->ThreadStartUp() == olc::FAIL)	return;
+		olc::Trace::SetThreadName("Engine");
 
 		// Do engine context specific initialisation
 		olc_PrepareEngine();
@@ -1673,6 +2103,8 @@ namespace olc
 
 	void PixelGameEngine::olc_CoreUpdate()
 	{
+		olc::TraceScope traceFrame("Frame");
+
 		// Handle Timing
 		m_tp2 = std::chrono::system_clock::now();
 		std::chrono::duration<float> elapsedTime = m_tp2 - m_tp1;
@@ -1680,11 +2112,45 @@ namespace olc
 
 		// Our time per frame coefficient
 		float fElapsedTime = elapsedTime.count();
-		fLastElapsed = fElapsedTime;
 
 		// Some platforms will need to check for events
+		auto tpPhase = olc::Profiler::Clock::now();
 		platform->HandleSystemEvent();
 
+		// A replay overrides whatever the platform reported, and ends the
+		// engine once it runs out of frames
+		if (bReplayingInput)
+		{
+			if (nReplayFrame >= inputRecording.vFrames.size())
+			{
+				bAtomActive = false;
+				return;
+			}
+
+			const InputRecording::Frame& frame = inputRecording.vFrames[nReplayFrame++];
+			for (uint32_t i = 0; i < 256; i++)
+				pKeyNewState[i] = (frame.pKeys[i / 8] >> (i % 8)) & 1;
+			for (uint32_t i = 0; i < nMouseButtons; i++)
+				pMouseNewState[i] = (frame.nButtons >> i) & 1;
+			vMousePosCache = { frame.nMouseX, frame.nMouseY };
+			nMouseWheelDeltaCache = frame.nMouseWheel;
+			fElapsedTime = frame.fElapsedTime;
+		}
+		else if (bRecordingInput)
+		{
+			InputRecording::Frame frame;
+			for (uint32_t i = 0; i < 256; i++)
+				frame.pKeys[i / 8] |= uint8_t(pKeyNewState[i]) << (i % 8);
+			for (uint32_t i = 0; i < nMouseButtons; i++)
+				frame.nButtons |= uint8_t(pMouseNewState[i]) << i;
+			frame.nMouseX = vMousePosCache.x;
+			frame.nMouseY = vMousePosCache.y;
+			frame.nMouseWheel = nMouseWheelDeltaCache;
+			frame.fElapsedTime = fElapsedTime;
+			inputRecording.vFrames.push_back(frame);
+		}
+		fLastElapsed = fElapsedTime;
+
 		// Compare hardware input states from previous frame
 		auto ScanHardware = [&](HWButton* pKeys, bool* pStateOld, bool* pStateNew, uint32_t nKeyCount)
 		{
@@ -1716,12 +2182,18 @@ namespace olc
 		vMousePos = vMousePosCache;
 		nMouseWheelDelta = nMouseWheelDeltaCache;
 		nMouseWheelDeltaCache = 0;
+		profiler.Record(nPhaseInput, tpPhase);
 
 		renderer->ClearBuffer(olc::BLACK, true);
 
 		// Handle Frame Update
-		if (!OnUserUpdate(fElapsedTime))
-			bAtomActive = false;
+		tpPhase = olc::Profiler::Clock::now();
+		{
+			olc::TraceScope traceUpdate("OnUserUpdate");
+			if (!OnUserUpdate(fElapsedTime))
+				bAtomActive = false;
+		}
+		profiler.Record(nPhaseUserUpdate, tpPhase);
 
 		// Display Frame
 		renderer->UpdateViewport(vViewPos, vViewSize);
@@ -1732,6 +2204,13 @@ namespace olc
 		vLayers[0].bShow = true;
 		renderer->PrepareDrawing();
 
+		// Every layer adds to the same three phases
+		auto Elapsed = [](olc::Profiler::Clock::time_point tp)
+		{
+			return std::chrono::duration<float, std::milli>(olc::Profiler::Clock::now() - tp).count();
+		};
+		float fUploadMs = 0.0f, fLayersMs = 0.0f, fDecalsMs = 0.0f;
+
 		for (auto layer = vLayers.rbegin(); layer != vLayers.rend(); ++layer)
 		{
 			if (layer->bShow)
@@ -1741,16 +2220,31 @@ namespace olc
 					renderer->ApplyTexture(layer->nResID);
 					if (layer->bUpdate)
 					{
-						renderer->UpdateTexture(layer->nResID, layer->pDrawTarget);
+						tpPhase = olc::Profiler::Clock::now();
+						// Only what changed since the last frame goes to the GPU
+						layer->dirty.Add(layer->pDrawTarget->dirty);
+						layer->pDrawTarget->dirty.Clear();
+						layer->dirty.Clip(layer->pDrawTarget->width, layer->pDrawTarget->height);
+						if (!layer->dirty.Empty())
+						{
+							olc::TraceScope traceUpload("Upload");
+							renderer->UpdateTextureRegion(layer->nResID, layer->pDrawTarget, layer->dirty);
+						}
+						layer->dirty.Clear();
 						layer->bUpdate = false;
+						fUploadMs += Elapsed(tpPhase);
 					}
 
+					tpPhase = olc::Profiler::Clock::now();
 					renderer->DrawLayerQuad(layer->vOffset, layer->vScale, layer->tint);
+					fLayersMs += Elapsed(tpPhase);
 
 					// Display Decals in order for this layer
+					tpPhase = olc::Profiler::Clock::now();
 					for (auto& decal : layer->vecDecalInstance)
 						renderer->DrawDecalQuad(decal);
 					layer->vecDecalInstance.clear();
+					fDecalsMs += Elapsed(tpPhase);
 				}
 				else
 				{
@@ -1760,8 +2254,21 @@ namespace olc
 			}
 		}
 
+		profiler.Record(nPhaseUpload, fUploadMs);
+		profiler.Record(nPhaseLayers, fLayersMs);
+		profiler.Record(nPhaseDecals, fDecalsMs);
+
 		// Present Graphics to screen
-		renderer->DisplayFrame();
+		tpPhase = olc::Profiler::Clock::now();
+		{
+			olc::TraceScope tracePresent("Present");
+			renderer->DisplayFrame();
+		}
+		profiler.Record(nPhasePresent, tpPhase);
+
+		// Batch runs stop after a fixed number of frames
+		if (nFrameLimit > 0 && ++nFramesRun >= nFrameLimit)
+			bAtomActive = false;
 
 		// Update Title Bar
 		fFrameTimer += fElapsedTime;
@@ -1866,6 +2373,7 @@ namespace olc
 	private:
 		glDeviceContext_t glDeviceContext = 0;
 		glRenderContext_t glRenderContext = 0;
+		std::map<uint32_t, olc::vi2d> mapTextureSize;
 
 #if defined(__linux__) || defined(__FreeBSD__)
 		X11::Display* olc_Display = nullptr;
@@ -2018,18 +2526,51 @@ namespace olc
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 			glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+			// Storage is allocated once here, updates only write into it
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			mapTextureSize[id] = { int32_t(width), int32_t(height) };
 			return id;
 		}
 
 		uint32_t DeleteTexture(const uint32_t id) override
 		{
 			glDeleteTextures(1, &id);
+			mapTextureSize.erase(id);
 			return id;
 		}
 
 		void UpdateTexture(uint32_t id, olc::Sprite* spr) override
 		{
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, spr->width, spr->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetData());
+			olc::vi2d& size = mapTextureSize[id];
+			if (size.x == spr->width && size.y == spr->height)
+			{
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, spr->width, spr->height, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetData());
+			}
+			else
+			{
+				// The sprite was resized or reloaded, so the storage has to follow
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, spr->width, spr->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetData());
+				size = { spr->width, spr->height };
+			}
+		}
+
+		void UpdateTextureRegion(uint32_t id, olc::Sprite* spr, const olc::DirtyRegion& region) override
+		{
+			const olc::vi2d& size = mapTextureSize[id];
+			if (size.x != spr->width || size.y != spr->height)
+			{
+				UpdateTexture(id, spr);
+				return;
+			}
+
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, spr->width);
+			for (const auto& r : region.vRects)
+			{
+				const olc::Pixel* pData = spr->GetData() + r.y0 * spr->width + r.x0;
+				glTexSubImage2D(GL_TEXTURE_2D, 0, r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0, GL_RGBA, GL_UNSIGNED_BYTE, pData);
+			}
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 		}
 
 		void ApplyTexture(uint32_t id) override
@@ -2055,6 +2596,109 @@ namespace olc
 // | END RENDERER: OpenGL 1.0 (the original, the best...)                         |
 // O------------------------------------------------------------------------------O
 
+// O------------------------------------------------------------------------------O
+// | START CHECK: Region uploads against a texture read back                      |
+// O------------------------------------------------------------------------------O
+#if defined(OLC_GFX_OPENGL10) && (defined(__linux__) || defined(__FreeBSD__))
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+namespace olc
+{
+	olc::rcode CheckRegionUploads(std::string& sError)
+	{
+		// Mesa's software rasterizer, with a context that needs no window
+		setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+		auto eglGetPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		EGLDisplay display = eglGetPlatformDisplay ? eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr) : EGL_NO_DISPLAY;
+		EGLint major = 0, minor = 0;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+		{
+			sError = "no surfaceless EGL display, Mesa is required";
+			return olc::FAIL;
+		}
+		EGLContext context = EGL_NO_CONTEXT;
+		if (eglBindAPI(EGL_OPENGL_API))
+			context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, nullptr);
+		if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		{
+			sError = "could not create an OpenGL context";
+			eglTerminate(display);
+			return olc::FAIL;
+		}
+
+		// An odd width, so rows of a region are never contiguous in the sprite
+		const int32_t nWidth = 61, nHeight = 37;
+		olc::Sprite target(nWidth, nHeight);
+		olc::Sprite brush(7, 5);
+		for (int32_t i = 0; i < nWidth * nHeight; i++)
+			target.GetData()[i] = olc::Pixel(uint8_t(i), uint8_t(i >> 8), uint8_t(i * 7), 255);
+		for (int32_t i = 0; i < brush.width * brush.height; i++)
+			brush.GetData()[i] = olc::Pixel(uint8_t(i * 31), 200, uint8_t(255 - i), 255);
+
+		olc::Renderer_OGL10 gl;
+		uint32_t id = gl.CreateTexture(nWidth, nHeight);
+		gl.ApplyTexture(id);
+		gl.UpdateTexture(id, &target);
+		target.dirty.Clear();
+
+		olc::PixelGameEngine pge;
+		pge.SetDrawTarget(&target);
+		std::vector<olc::Pixel> vReadBack(nWidth * nHeight);
+		olc::rcode result = olc::OK;
+		for (int32_t nRound = 0; nRound < 16 && result == olc::OK; nRound++)
+		{
+			// Small shapes in separate places, some hanging over the edges,
+			// so each round uploads several partial rectangles
+			olc::Pixel col(uint8_t(nRound * 16), uint8_t(255 - nRound * 9), 77, 255);
+			int32_t x = (nRound * 13) % nWidth - 3, y = (nRound * 7) % nHeight - 2;
+			pge.FillRect(x, y, 5, 4, col);
+			pge.DrawSprite(nWidth - 1 - x, y + 9, &brush, 1 + nRound % 2, uint8_t(nRound % 4));
+			pge.DrawPartialSprite(x + 20, nHeight - 1 - y, &brush, 1, 1, 4, 3);
+			pge.DrawLine(x, nHeight - 1 - y, x + 9, nHeight - 5 - y, col);
+			pge.FillCircle(nWidth / 2 + x / 4, nHeight / 2, nRound % 5, col);
+			pge.FillTriangle(x + 30, y, x + 36, y + 3, x + 31, y + 7, col);
+			pge.Draw(nRound * 3 % nWidth, nHeight - 1, col);
+			target.SetPixel(nWidth - 1, nRound, col);
+			target.MarkDirty(nWidth - 1, nRound, 1, 1);
+
+			target.dirty.Clip(nWidth, nHeight);
+			gl.ApplyTexture(id);
+			gl.UpdateTextureRegion(id, &target, target.dirty);
+			target.dirty.Clear();
+
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, vReadBack.data());
+			for (int32_t i = 0; i < nWidth * nHeight; i++)
+				if (vReadBack[i] != target.GetData()[i])
+				{
+					sError = "round " + std::to_string(nRound) + ": texel (" + std::to_string(i % nWidth) + ", " +
+						std::to_string(i / nWidth) + ") differs from the sprite";
+					result = olc::FAIL;
+					break;
+				}
+		}
+
+		gl.DeleteTexture(id);
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		return result;
+	}
+}
+#else
+namespace olc
+{
+	olc::rcode CheckRegionUploads(std::string& sError)
+	{
+		sError = "needs the OpenGL 1.0 renderer and Mesa's EGL";
+		return olc::FAIL;
+	}
+}
+#endif
+// O------------------------------------------------------------------------------O
+// | END CHECK: Region uploads against a texture read back                        |
+// O------------------------------------------------------------------------------O
+
 
 // O------------------------------------------------------------------------------O
 // | START PLATFORM: MICROSOFT WINDOWS XP, VISTA, 7, 8, 10                        |
@@ -2302,6 +2946,7 @@ namespace olc
 		width = bmp->GetWidth();
 		height = bmp->GetHeight();
 		pColData = new Pixel[width * height];
+		bOwnsData = true;
 
 		for (int y = 0; y < height; y++)
 			for (int x = 0; x < width; x++)
@@ -2310,6 +2955,7 @@ namespace olc
 				bmp->GetPixel(x, y, &c);
 				SetPixel(x, y, olc::Pixel(c.GetRed(), c.GetGreen(), c.GetBlue(), c.GetAlpha()));
 			}
+		MarkDirty(0, 0, width, height);
 		delete bmp;
 		return olc::OK;
 	}
@@ -2600,6 +3246,7 @@ namespace olc
 			////////////////////////////////////////////////////////////////////////////
 			// Create sprite array
 			pColData = new Pixel[width * height];
+			bOwnsData = true;
 			// Iterate through image rows, converting into sprite format
 			for (int y = 0; y < height; y++)
 			{
@@ -2610,6 +3257,7 @@ namespace olc
 					SetPixel(x, y, Pixel(px[0], px[1], px[2], px[3]));
 				}
 			}
+			MarkDirty(0, 0, width, height);
 
 			for (int y = 0; y < height; y++) // Thanks maksym33
 				free(row_pointers[y]);
@@ -2655,6 +3303,328 @@ namespace olc
 // | END PLATFORM: LINUX                                                          |
 // O------------------------------------------------------------------------------O
 
+// O------------------------------------------------------------------------------O
+// | START RENDERER: CPU (headless)                                               |
+// O------------------------------------------------------------------------------O
+namespace olc
+{
+	// Draws into a sprite in memory, so the engine runs where there is no
+	// display or GPU. It follows the OpenGL 1.0 renderer: nearest sampling,
+	// repeating texture coordinates, tint modulation and alpha blending.
+	class Renderer_CPU : public olc::Renderer
+	{
+	private:
+		std::map<uint32_t, std::unique_ptr<olc::Sprite>> mapTextures;
+		uint32_t nNextTexture = 1;
+		uint32_t nBoundTexture = 0;
+		std::unique_ptr<olc::Sprite> pBackBuffer;
+		std::unique_ptr<olc::Sprite> pFrontBuffer;
+		olc::vi2d vViewPos = { 0, 0 };
+		olc::vi2d vViewSize = { 0, 0 };
+		std::vector<int32_t> vColumnMap;
+
+		static int32_t Wrap(int32_t i, int32_t n)
+		{
+			i %= n;
+			return i < 0 ? i + n : i;
+		}
+
+		static olc::Pixel Modulate(const olc::Pixel& p, const olc::Pixel& tint)
+		{
+			if (tint == olc::WHITE) return p;
+			return olc::Pixel((p.r * tint.r + 127) / 255, (p.g * tint.g + 127) / 255,
+				(p.b * tint.b + 127) / 255, (p.a * tint.a + 127) / 255);
+		}
+
+		// GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+		static void Blend(olc::Pixel& dst, const olc::Pixel& src)
+		{
+			if (src.a == 255) { dst = src; return; }
+			if (src.a == 0) return;
+			uint32_t a = src.a, ia = 255 - src.a;
+			dst = olc::Pixel((src.r * a + dst.r * ia + 127) / 255, (src.g * a + dst.g * ia + 127) / 255,
+				(src.b * a + dst.b * ia + 127) / 255, (src.a * a + dst.a * ia + 127) / 255);
+		}
+
+		olc::Sprite* GetTexture(uint32_t id)
+		{
+			auto it = mapTextures.find(id);
+			return it == mapTextures.end() ? nullptr : it->second.get();
+		}
+
+		// Fills one triangle of a decal quad. Texture coordinates and colour
+		// are interpolated in screen space and divided by w, as glTexCoord4f does.
+		void DrawDecalTriangle(const olc::DecalInstance& decal, olc::Sprite* tex, int i0, int i1, int i2)
+		{
+			const int idx[3] = { i0, i1, i2 };
+			olc::vf2d p[3];
+			for (int i = 0; i < 3; i++)
+			{
+				const olc::vf2d& ndc = decal.pos[idx[i]];
+				p[i] = { float(vViewPos.x) + (ndc.x + 1.0f) * 0.5f * float(vViewSize.x),
+					float(vViewPos.y) + (1.0f - ndc.y) * 0.5f * float(vViewSize.y) };
+			}
+
+			float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+			if (area == 0.0f) return;
+			float inv = 1.0f / area;
+
+			int32_t x0 = std::max({ int32_t(std::floor(std::min({ p[0].x, p[1].x, p[2].x }))), vViewPos.x, 0 });
+			int32_t y0 = std::max({ int32_t(std::floor(std::min({ p[0].y, p[1].y, p[2].y }))), vViewPos.y, 0 });
+			int32_t x1 = std::min({ int32_t(std::ceil(std::max({ p[0].x, p[1].x, p[2].x }))), vViewPos.x + vViewSize.x, pBackBuffer->width });
+			int32_t y1 = std::min({ int32_t(std::ceil(std::max({ p[0].y, p[1].y, p[2].y }))), vViewPos.y + vViewSize.y, pBackBuffer->height });
+
+			// Pixels exactly on an edge belong to one side only, so the two
+			// triangles of a quad never blend the shared diagonal twice
+			auto Inside = [&](float e, const olc::vf2d& a, const olc::vf2d& b)
+			{
+				if (e != 0.0f) return (e > 0.0f) == (area > 0.0f);
+				float dy = b.y - a.y;
+				return dy > 0.0f || (dy == 0.0f && b.x < a.x);
+			};
+
+			olc::Pixel* pFrame = pBackBuffer->GetData();
+			for (int32_t y = y0; y < y1; y++)
+			{
+				for (int32_t x = x0; x < x1; x++)
+				{
+					olc::vf2d c = { float(x) + 0.5f, float(y) + 0.5f };
+					float e0 = (p[2].x - p[1].x) * (c.y - p[1].y) - (p[2].y - p[1].y) * (c.x - p[1].x);
+					float e1 = (p[0].x - p[2].x) * (c.y - p[2].y) - (p[0].y - p[2].y) * (c.x - p[2].x);
+					float e2 = (p[1].x - p[0].x) * (c.y - p[0].y) - (p[1].y - p[0].y) * (c.x - p[0].x);
+					if (!Inside(e0, p[1], p[2]) || !Inside(e1, p[2], p[0]) || !Inside(e2, p[0], p[1]))
+						continue;
+
+					float b[3] = { e0 * inv, e1 * inv, e2 * inv };
+					olc::Pixel src;
+					if (tex == nullptr)
+					{
+						float r = 0.0f, g = 0.0f, bl = 0.0f, a = 0.0f;
+						for (int i = 0; i < 3; i++)
+						{
+							const olc::Pixel& t = decal.tint[idx[i]];
+							r += b[i] * t.r; g += b[i] * t.g; bl += b[i] * t.b; a += b[i] * t.a;
+						}
+						src = olc::Pixel(uint8_t(r + 0.5f), uint8_t(g + 0.5f), uint8_t(bl + 0.5f), uint8_t(a + 0.5f));
+					}
+					else
+					{
+						float u = 0.0f, v = 0.0f, w = 0.0f;
+						for (int i = 0; i < 3; i++)
+						{
+							u += b[i] * decal.uv[idx[i]].x;
+							v += b[i] * decal.uv[idx[i]].y;
+							w += b[i] * decal.w[idx[i]];
+						}
+						int32_t tx = Wrap(int32_t(std::floor(u / w * float(tex->width))), tex->width);
+						int32_t ty = Wrap(int32_t(std::floor(v / w * float(tex->height))), tex->height);
+						src = Modulate(tex->GetData()[ty * tex->width + tx], decal.tint[0]);
+					}
+					Blend(pFrame[y * pBackBuffer->width + x], src);
+				}
+			}
+		}
+
+	public:
+		void PrepareDevice() override
+		{ }
+
+		olc::rcode CreateDevice(std::vector<void*> params, bool bFullScreen, bool bVSYNC) override
+		{
+			olc::vi2d size = ptrPGE->GetWindowSize();
+			pBackBuffer = std::make_unique<olc::Sprite>(size.x, size.y);
+			pFrontBuffer = std::make_unique<olc::Sprite>(size.x, size.y);
+			return olc::rcode::OK;
+		}
+
+		olc::rcode DestroyDevice() override
+		{
+			// The front buffer stays readable after the engine stops
+			mapTextures.clear();
+			pBackBuffer.reset();
+			return olc::rcode::OK;
+		}
+
+		void DisplayFrame() override
+		{
+			std::swap(pBackBuffer, pFrontBuffer);
+		}
+
+		void PrepareDrawing() override
+		{ }
+
+		void DrawLayerQuad(const olc::vf2d& offset, const olc::vf2d& scale, const olc::Pixel tint) override
+		{
+			olc::Sprite* tex = GetTexture(nBoundTexture);
+			if (tex == nullptr || tex->width == 0 || tex->height == 0) return;
+
+			// Nearest sampling needs one texture column per viewport column,
+			// worked out once for the whole quad
+			vColumnMap.resize(vViewSize.x);
+			for (int32_t x = 0; x < vViewSize.x; x++)
+			{
+				float u = (float(x) + 0.5f) / float(vViewSize.x) * scale.x + offset.x;
+				vColumnMap[x] = Wrap(int32_t(std::floor(u * float(tex->width))), tex->width);
+			}
+
+			int32_t xStart = std::max(0, -vViewPos.x);
+			int32_t xEnd = std::min(vViewSize.x, pBackBuffer->width - vViewPos.x);
+			const olc::Pixel* pTex = tex->GetData();
+			for (int32_t y = 0; y < vViewSize.y; y++)
+			{
+				int32_t fy = vViewPos.y + y;
+				if (fy < 0 || fy >= pBackBuffer->height) continue;
+
+				float v = (float(y) + 0.5f) / float(vViewSize.y) * scale.y + offset.y;
+				const olc::Pixel* pRow = pTex + Wrap(int32_t(std::floor(v * float(tex->height))), tex->height) * tex->width;
+				olc::Pixel* pDst = pBackBuffer->GetData() + fy * pBackBuffer->width + vViewPos.x;
+				for (int32_t x = xStart; x < xEnd; x++)
+					Blend(pDst[x], Modulate(pRow[vColumnMap[x]], tint));
+			}
+		}
+
+		void DrawDecalQuad(const olc::DecalInstance& decal) override
+		{
+			olc::Sprite* tex = decal.decal == nullptr ? nullptr : GetTexture(decal.decal->id);
+			if (decal.decal != nullptr && tex == nullptr) return;
+
+			// GL_QUADS is drawn as the fan 0-1-2, 0-2-3
+			DrawDecalTriangle(decal, tex, 0, 1, 2);
+			DrawDecalTriangle(decal, tex, 0, 2, 3);
+		}
+
+		uint32_t CreateTexture(const uint32_t width, const uint32_t height) override
+		{
+			uint32_t id = nNextTexture++;
+			mapTextures[id] = std::make_unique<olc::Sprite>(int32_t(width), int32_t(height));
+			return id;
+		}
+
+		uint32_t DeleteTexture(const uint32_t id) override
+		{
+			mapTextures.erase(id);
+			return id;
+		}
+
+		void UpdateTexture(uint32_t id, olc::Sprite* spr) override
+		{
+			std::unique_ptr<olc::Sprite>& tex = mapTextures[id];
+			if (!tex || tex->width != spr->width || tex->height != spr->height)
+				tex = std::make_unique<olc::Sprite>(spr->width, spr->height);
+			std::copy(spr->GetData(), spr->GetData() + spr->width * spr->height, tex->GetData());
+		}
+
+		void UpdateTextureRegion(uint32_t id, olc::Sprite* spr, const olc::DirtyRegion& region) override
+		{
+			olc::Sprite* tex = GetTexture(id);
+			if (tex == nullptr || tex->width != spr->width || tex->height != spr->height)
+			{
+				UpdateTexture(id, spr);
+				return;
+			}
+
+			for (const auto& r : region.vRects)
+				for (int32_t y = r.y0; y < r.y1; y++)
+				{
+					const olc::Pixel* pSrc = spr->GetData() + y * spr->width;
+					std::copy(pSrc + r.x0, pSrc + r.x1, tex->GetData() + y * tex->width + r.x0);
+				}
+		}
+
+		void ApplyTexture(uint32_t id) override
+		{
+			nBoundTexture = id;
+		}
+
+		void ClearBuffer(olc::Pixel p, bool bDepth) override
+		{
+			std::fill(pBackBuffer->GetData(), pBackBuffer->GetData() + pBackBuffer->width * pBackBuffer->height, p);
+		}
+
+		void UpdateViewport(const olc::vi2d& pos, const olc::vi2d& size) override
+		{
+			vViewPos = pos;
+			vViewSize = size;
+		}
+
+		olc::Sprite* GetFrameBuffer() const override
+		{
+			return pFrontBuffer.get();
+		}
+	};
+}
+// O------------------------------------------------------------------------------O
+// | END RENDERER: CPU (headless)                                                 |
+// O------------------------------------------------------------------------------O
+
+
+// O------------------------------------------------------------------------------O
+// | START PLATFORM: HEADLESS                                                     |
+// O------------------------------------------------------------------------------O
+namespace olc
+{
+	// No window and no input. The engine thread runs frames back to back
+	// until OnUserUpdate returns false or the frame limit is reached.
+	class Platform_Headless : public olc::Platform
+	{
+	public:
+		virtual olc::rcode ApplicationStartUp() override
+		{
+			return olc::rcode::OK;
+		}
+
+		virtual olc::rcode ApplicationCleanUp() override
+		{
+			return olc::rcode::OK;
+		}
+
+		virtual olc::rcode ThreadStartUp() override
+		{
+			return olc::rcode::OK;
+		}
+
+		virtual olc::rcode ThreadCleanUp() override
+		{
+			renderer->DestroyDevice();
+			return olc::OK;
+		}
+
+		virtual olc::rcode CreateGraphics(bool bFullScreen, bool bEnableVSYNC, const olc::vi2d& vViewPos, const olc::vi2d& vViewSize) override
+		{
+			if (renderer->CreateDevice({}, false, false) == olc::rcode::OK)
+			{
+				renderer->UpdateViewport(vViewPos, vViewSize);
+				return olc::rcode::OK;
+			}
+			else
+				return olc::rcode::FAIL;
+		}
+
+		virtual olc::rcode CreateWindowPane(const olc::vi2d& vWindowPos, olc::vi2d& vWindowSize, bool bFullScreen) override
+		{
+			return olc::OK;
+		}
+
+		virtual olc::rcode SetWindowTitle(const std::string& s) override
+		{
+			return olc::OK;
+		}
+
+		virtual olc::rcode StartSystemEventLoop() override
+		{
+			return olc::OK;
+		}
+
+		virtual olc::rcode HandleSystemEvent() override
+		{
+			return olc::OK;
+		}
+	};
+}
+// O------------------------------------------------------------------------------O
+// | END PLATFORM: HEADLESS                                                       |
+// O------------------------------------------------------------------------------O
+
 namespace olc
 {
 	void PixelGameEngine::olc_ConfigureSystem()
@@ -2679,10 +3649,22 @@ namespace olc
 		renderer = std::make_unique<olc::Renderer_DX10>();
 #endif
 
+#if defined(OLC_PGE_HEADLESS)
+		olc_ConfigureHeadless();
+#endif
+
 		//// Associate components with PGE instance
 		platform->ptrPGE = this;
 		renderer->ptrPGE = this;
 	}
+
+	void PixelGameEngine::olc_ConfigureHeadless()
+	{
+		platform = std::make_unique<olc::Platform_Headless>();
+		renderer = std::make_unique<olc::Renderer_CPU>();
+		platform->ptrPGE = this;
+		renderer->ptrPGE = this;
+	}
 }
 
 #endif // End olc namespace
@@ -0,0 +1,241 @@
+#include "simulation.h"
+#include <cmath>
+
+// Brushes and emitters. Each shape is clipped to the world once, written
+// span by span into the planes, and wakes its bounding box once.
+
+namespace
+{
+	constexpr uint32_t fullDensity = UINT32_MAX;
+
+	// Maps a fill fraction onto the range of Random::Next
+	uint32_t DensityThreshold(float density)
+	{
+		if (density >= 1.0f)
+			return fullDensity;
+		if (density <= 0.0f)
+			return 0;
+		return uint32_t(double(density) * 4294967296.0);
+	}
+}
+
+void Simulation::FillSpan(int y, int x0, int x1, uint8_t material, uint32_t threshold)
+{
+	const std::vector<olc::Pixel>& palette = registry.Get(material).palette;
+	int paletteSize = int(palette.size());
+	uint8_t stamp = uint8_t(tick - 1);
+	int row = Index(0, y);
+
+	for (int x = x0; x <= x1; ++x)
+	{
+		if (threshold != fullDensity && mainRandom.Next() >= threshold)
+			continue;
+
+		int index = row + x;
+		if (material != MaterialId::Empty && materials[index] != MaterialId::Empty)
+			continue;
+
+		SetCell(x, y, material, palette[paletteSize == 1 ? 0 : mainRandom.Below(paletteSize)], stamp);
+		AddHeat(x, y, material);
+	}
+}
+
+void Simulation::FillRect(int x, int y, int w, int h, uint8_t material, float density)
+{
+	int x0 = std::max(x, 0);
+	int y0 = std::max(y, 0);
+	int x1 = std::min(x + w - 1, worldWidth - 1);
+	int y1 = std::min(y + h - 1, worldHeight - 1);
+	if (x0 > x1 || y0 > y1 || material >= registry.GetCount())
+		return;
+
+	uint32_t threshold = DensityThreshold(density);
+	for (int row = y0; row <= y1; ++row)
+		FillSpan(row, x0, x1, material, threshold);
+
+	WakeRect(x0, y0, x1, y1);
+}
+
+void Simulation::FillCircle(int cx, int cy, int radius, uint8_t material, float density)
+{
+	FillLine(cx, cy, cx, cy, radius, material, density);
+}
+
+void Simulation::FillLine(int x0, int y0, int x1, int y1, int radius, uint8_t material, float density)
+{
+	radius = std::max(radius, 0);
+	int top = std::max(std::min(y0, y1) - radius, 0);
+	int bottom = std::min(std::max(y0, y1) + radius, worldHeight - 1);
+	if (top > bottom || material >= registry.GetCount())
+		return;
+
+	// The shape is a capsule: two end circles joined by a rectangle. It is
+	// convex, so every row covers a single span, the union of the spans of
+	// those three parts.
+	float r2 = float(radius * radius + radius);
+	float dx = float(x1 - x0);
+	float dy = float(y1 - y0);
+	float length = std::sqrt(dx * dx + dy * dy);
+
+	float nx = length > 0.0f ? -dy / length * std::sqrt(r2) : 0.0f;
+	float ny = length > 0.0f ? dx / length * std::sqrt(r2) : 0.0f;
+	const olc::vf2d corners[4] =
+	{
+		{ x0 + nx, y0 + ny }, { x1 + nx, y1 + ny },
+		{ x1 - nx, y1 - ny }, { x0 - nx, y0 - ny }
+	};
+
+	uint32_t threshold = DensityThreshold(density);
+	int left = worldWidth;
+	int right = -1;
+
+	for (int y = top; y <= bottom; ++y)
+	{
+		float lo = INFINITY;
+		float hi = -INFINITY;
+
+		auto AddCircle = [&](int cx, int cy)
+		{
+			float h2 = r2 - float((y - cy) * (y - cy));
+			if (h2 >= 0.0f)
+			{
+				float half = std::sqrt(h2);
+				lo = std::min(lo, cx - half);
+				hi = std::max(hi, cx + half);
+			}
+		};
+		AddCircle(x0, y0);
+		AddCircle(x1, y1);
+
+		if (length > 0.0f)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				const olc::vf2d& p = corners[i];
+				const olc::vf2d& q = corners[(i + 1) % 4];
+				if ((p.y - y) * (q.y - y) > 0.0f)
+					continue;
+
+				if (p.y == q.y)
+				{
+					lo = std::min(lo, std::min(p.x, q.x));
+					hi = std::max(hi, std::max(p.x, q.x));
+				}
+				else
+				{
+					float x = p.x + (float(y) - p.y) * (q.x - p.x) / (q.y - p.y);
+					lo = std::min(lo, x);
+					hi = std::max(hi, x);
+				}
+			}
+		}
+
+		if (lo > hi)
+			continue;
+
+		int spanStart = std::max(int(std::ceil(lo)), 0);
+		int spanEnd = std::min(int(std::floor(hi)), worldWidth - 1);
+		if (spanStart > spanEnd)
+			continue;
+
+		FillSpan(y, spanStart, spanEnd, material, threshold);
+		left = std::min(left, spanStart);
+		right = std::max(right, spanEnd);
+	}
+
+	if (left <= right)
+		WakeRect(left, top, right, bottom);
+}
+
+void Simulation::Spray(int cx, int cy, int radius, uint8_t material, int count)
+{
+	radius = std::max(radius, 0);
+	int x0 = std::max(cx - radius, 0);
+	int y0 = std::max(cy - radius, 0);
+	int x1 = std::min(cx + radius, worldWidth - 1);
+	int y1 = std::min(cy + radius, worldHeight - 1);
+	if (x0 > x1 || y0 > y1 || material >= registry.GetCount())
+		return;
+
+	const std::vector<olc::Pixel>& palette = registry.Get(material).palette;
+	int paletteSize = int(palette.size());
+	int r2 = radius * radius + radius;
+	uint8_t stamp = uint8_t(tick - 1);
+
+	for (int i = 0; i < count; ++i)
+	{
+		int dx, dy;
+		do
+		{
+			dx = mainRandom.Range(-radius, radius);
+			dy = mainRandom.Range(-radius, radius);
+		} while (dx * dx + dy * dy > r2);
+
+		int x = cx + dx;
+		int y = cy + dy;
+		if (x < x0 || x > x1 || y < y0 || y > y1)
+			continue;
+
+		int index = Index(x, y);
+		if (material != MaterialId::Empty && materials[index] != MaterialId::Empty)
+			continue;
+
+		SetCell(x, y, material, palette[paletteSize == 1 ? 0 : mainRandom.Below(paletteSize)], stamp);
+		AddHeat(x, y, material);
+	}
+
+	WakeRect(x0, y0, x1, y1);
+}
+
+int Simulation::AddEmitter(const Emitter& emitter)
+{
+	emitters.push_back(emitter);
+	return int(emitters.size()) - 1;
+}
+
+void Simulation::RemoveEmitter(int index)
+{
+	if (index >= 0 && index < int(emitters.size()))
+		emitters.erase(emitters.begin() + index);
+}
+
+void Simulation::RunEmitters()
+{
+	for (const Emitter& emitter : emitters)
+		Spray(emitter.x, emitter.y, emitter.radius, emitter.material, emitter.rate);
+}
+
+void Simulation::Apply(const SimulationCommand& command)
+{
+	// Commands are in world coordinates, which differ from the planes' once
+	// a streaming window has moved
+	int x0 = command.x0 - origin.x;
+	int y0 = command.y0 - origin.y;
+	int x1 = command.x1 - origin.x;
+	int y1 = command.y1 - origin.y;
+
+	switch (command.type)
+	{
+		case SimulationCommand::Type::Line:
+			FillLine(x0, y0, x1, y1, command.radius, command.material, command.density);
+			break;
+		case SimulationCommand::Type::Rect:
+			FillRect(x0, y0, x1 - x0 + 1, y1 - y0 + 1, command.material, command.density);
+			break;
+		case SimulationCommand::Type::Spray:
+			Spray(x0, y0, command.radius, command.material, command.count);
+			break;
+		case SimulationCommand::Type::AddEmitter:
+			AddEmitter({ x0, y0, command.radius, command.material, command.count });
+			break;
+		case SimulationCommand::Type::RemoveEmitter:
+			RemoveEmitter(command.count);
+			break;
+		case SimulationCommand::Type::Burst:
+			Burst(x0, y0, command.radius, command.speed);
+			break;
+		case SimulationCommand::Type::SetWaterModel:
+			SetWaterModel(command.waterModel);
+			break;
+	}
+}
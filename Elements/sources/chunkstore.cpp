@@ -0,0 +1,215 @@
+#include "chunkstore.h"
+#include "runlength.h"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+// Chunk file layout, little-endian: the header, then the material and
+// color planes run-length encoded one after the other
+
+namespace
+{
+	constexpr char chunkMagic[4] = { 'E', 'C', 'H', 'K' };
+	constexpr uint32_t chunkVersion = 1;
+
+	struct ChunkHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t chunkSize;
+		uint32_t materialsSize;
+		uint32_t colorsSize;
+	};
+}
+
+ChunkStore::ChunkStore(const std::string& directory, int chunkSize) : directory(directory), chunkSize(chunkSize)
+{
+	std::error_code error;
+	_gfs::create_directories(directory, error);
+	thread = std::thread(&ChunkStore::Run, this);
+}
+
+ChunkStore::~ChunkStore()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+std::string ChunkStore::PathOf(uint64_t key) const
+{
+	return directory + "/" + std::to_string(int32_t(key >> 32)) + "_" + std::to_string(int32_t(key)) + ".chunk";
+}
+
+void ChunkStore::Save(olc::vi2d chunk, ChunkCells&& cells)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		uint64_t key = Key(chunk);
+		writes[key] = std::make_shared<const ChunkCells>(std::move(cells));
+		// Whatever was prefetched for it is out of date now
+		loaded.erase(key);
+	}
+	wake.notify_one();
+}
+
+void ChunkStore::Prefetch(const std::vector<olc::vi2d>& chunks)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		wanted.clear();
+		toLoad.clear();
+		for (const olc::vi2d& chunk : chunks)
+		{
+			uint64_t key = Key(chunk);
+			wanted.insert(key);
+			if (loaded.count(key) == 0)
+				toLoad.push_back(key);
+		}
+
+		for (auto it = loaded.begin(); it != loaded.end();)
+			it = wanted.count(it->first) ? std::next(it) : loaded.erase(it);
+	}
+	wake.notify_one();
+}
+
+ChunkCells ChunkStore::Load(olc::vi2d chunk)
+{
+	uint64_t key = Key(chunk);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto write = writes.find(key);
+		if (write != writes.end())
+			return *write->second;
+
+		auto ready = loaded.find(key);
+		if (ready != loaded.end())
+		{
+			ChunkCells cells = std::move(ready->second);
+			loaded.erase(ready);
+			return cells;
+		}
+	}
+
+	// Not written since and not prefetched, so the file is current and
+	// nothing writes it while it is read here
+	return ReadFile(key);
+}
+
+void ChunkStore::Flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	flushed.wait(lock, [this] { return writes.empty(); });
+}
+
+bool ChunkStore::WriteFile(uint64_t key, const ChunkCells& cells) const
+{
+	// Nothing is stored for empty space
+	if (cells.Empty())
+	{
+		std::remove(PathOf(key).c_str());
+		return true;
+	}
+
+	std::vector<uint8_t> file(sizeof(ChunkHeader));
+	EncodeRuns(cells.materials.data(), cells.materials.size(), file);
+	size_t materialsSize = file.size() - sizeof(ChunkHeader);
+	EncodeRuns(cells.colors.data(), cells.colors.size(), file);
+
+	ChunkHeader header;
+	memcpy(header.magic, chunkMagic, sizeof(chunkMagic));
+	header.version = chunkVersion;
+	header.chunkSize = uint32_t(chunkSize);
+	header.materialsSize = uint32_t(materialsSize);
+	header.colorsSize = uint32_t(file.size() - sizeof(ChunkHeader) - materialsSize);
+	memcpy(file.data(), &header, sizeof(header));
+
+	std::ofstream out(PathOf(key), std::ios::binary);
+	out.write(reinterpret_cast<const char*>(file.data()), std::streamsize(file.size()));
+	return out.good();
+}
+
+ChunkCells ChunkStore::ReadFile(uint64_t key) const
+{
+	ChunkCells cells;
+	std::ifstream in(PathOf(key), std::ios::binary | std::ios::ate);
+	if (!in.is_open())
+		return cells;
+
+	std::vector<uint8_t> file(size_t(in.tellg()));
+	in.seekg(0);
+	in.read(reinterpret_cast<char*>(file.data()), std::streamsize(file.size()));
+
+	ChunkHeader header;
+	if (!in.good() || file.size() < sizeof(header))
+		return cells;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, chunkMagic, sizeof(chunkMagic)) != 0 || header.version != chunkVersion ||
+		header.chunkSize != uint32_t(chunkSize) || uint64_t(header.materialsSize) + header.colorsSize != file.size() - sizeof(header))
+		return cells;
+
+	// A damaged chunk comes back empty rather than half decoded
+	size_t count = size_t(chunkSize) * chunkSize;
+	cells.materials.resize(count);
+	cells.colors.resize(count);
+	const uint8_t* data = file.data() + sizeof(header);
+	if (!DecodeRuns(data, header.materialsSize, cells.materials.data(), count) ||
+		!DecodeRuns(data + header.materialsSize, header.colorsSize, cells.colors.data(), count))
+		return ChunkCells();
+	return cells;
+}
+
+void ChunkStore::Run()
+{
+	olc::Trace::SetThreadName("Chunk IO");
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		wake.wait(lock, [this] { return stopping || !writes.empty() || !toLoad.empty(); });
+
+		// Writes go first, and all of them are finished before stopping
+		if (!writes.empty())
+		{
+			auto write = writes.begin();
+			uint64_t key = write->first;
+			std::shared_ptr<const ChunkCells> cells = write->second;
+			lock.unlock();
+			{
+				olc::TraceScope traceWrite("Chunk write");
+				WriteFile(key, *cells);
+			}
+			lock.lock();
+
+			// Saved again while it was being written, so it goes round again
+			write = writes.find(key);
+			if (write != writes.end() && write->second == cells)
+				writes.erase(write);
+			if (writes.empty())
+				flushed.notify_all();
+			continue;
+		}
+
+		if (stopping)
+			break;
+
+		uint64_t key = toLoad.back();
+		toLoad.pop_back();
+		if (loaded.count(key) || writes.count(key))
+			continue;
+
+		lock.unlock();
+		ChunkCells cells;
+		{
+			olc::TraceScope traceRead("Chunk read");
+			cells = ReadFile(key);
+		}
+		lock.lock();
+
+		// Still wanted and not saved meanwhile
+		if (wanted.count(key) && writes.count(key) == 0)
+			loaded[key] = std::move(cells);
+	}
+}
@@ -0,0 +1,186 @@
+#include "simulation.h"
+#include <cmath>
+
+// Cells in flight. A cell thrown hard enough leaves the grid and becomes a
+// point with a velocity, which costs one integration step a tick instead of
+// a grid update, until its path runs into something and it is put back.
+
+void Simulation::Launch(FlyingParticles& list, int x, int y, float vx, float vy)
+{
+	int index = Index(x, y);
+	float limit = maxFlightSpeed;
+	vx = std::min(std::max(vx, -limit), limit);
+	vy = std::min(std::max(vy, -limit), limit);
+	list.Add(x + 0.5f, y + 0.5f, vx, vy, materials[index], colors[index], masses[index]);
+	ClearCell(x, y);
+	WakeCell(x, y);
+}
+
+void Simulation::Burst(int cx, int cy, int radius, float speed)
+{
+	radius = std::max(radius, 0);
+	int x0 = std::max(cx - radius, 0);
+	int y0 = std::max(cy - radius, 0);
+	int x1 = std::min(cx + radius, worldWidth - 1);
+	int y1 = std::min(cy + radius, worldHeight - 1);
+	int r2 = radius * radius + radius;
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			int dx = x - cx;
+			int dy = y - cy;
+			uint8_t material = materials[Index(x, y)];
+			if (dx * dx + dy * dy > r2 || material == MaterialId::Empty || registry.GetMovement(material) == MovementClass::Static)
+				continue;
+
+			// Straight out from the centre, faster the closer to it
+			float distance = std::sqrt(float(dx * dx + dy * dy));
+			float push = speed * (1.0f - distance / float(radius + 1)) * (0.5f + 0.5f * mainRandom.Float());
+			float nx = distance > 0.0f ? dx / distance : 0.0f;
+			float ny = distance > 0.0f ? dy / distance : -1.0f;
+			Launch(flying, x, y, nx * push, ny * push);
+		}
+	}
+}
+
+void Simulation::StepFlight()
+{
+	olc::TraceScope traceFlight("Flight");
+	for (FlyingParticles& list : launches)
+	{
+		flying.Append(list);
+		list.Clear();
+	}
+
+	flightMinX = flightMinY = INT_MAX;
+	flightMaxX = flightMaxY = INT_MIN;
+	size_t count = flying.Size();
+	if (count == 0)
+		return;
+
+	std::vector<int> fromX(count), fromY(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		fromX[i] = int(std::floor(flying.x[i]));
+		fromY[i] = int(std::floor(flying.y[i]));
+	}
+
+	// Every particle takes its ballistic step at once, with nothing but
+	// arithmetic on the arrays in the loop
+	float* x = flying.x.data();
+	float* y = flying.y.data();
+	const float* vx = flying.vx.data();
+	float* vy = flying.vy.data();
+	float limit = maxFlightSpeed;
+	for (size_t i = 0; i < count; ++i)
+	{
+		vy[i] = std::min(vy[i] + flightGravity, limit);
+		x[i] += vx[i];
+		y[i] += vy[i];
+	}
+
+	// Then each one follows its path through the grid. Those that land are
+	// dropped from the arrays, which keep their order.
+	size_t kept = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		int toX = int(std::floor(x[i]));
+		int toY = int(std::floor(y[i]));
+		flightMinX = std::min(flightMinX, std::min(fromX[i], toX));
+		flightMinY = std::min(flightMinY, std::min(fromY[i], toY));
+		flightMaxX = std::max(flightMaxX, std::max(fromX[i], toX));
+		flightMaxY = std::max(flightMaxY, std::max(fromY[i], toY));
+
+		if (Land(i, fromX[i], fromY[i]))
+			continue;
+		if (kept != i)
+			flying.Move(i, kept);
+		++kept;
+	}
+	flying.Resize(kept);
+}
+
+// Walks the cells from (fromX, fromY) to where particle i is now, one step
+// at a time along the longer axis. Returns true if the particle left the
+// air, put back into the grid in the last open cell before what it hit, or
+// lost off the side of the world or for want of room.
+bool Simulation::Land(size_t i, int fromX, int fromY)
+{
+	int toX = int(std::floor(flying.x[i]));
+	int toY = int(std::floor(flying.y[i]));
+	int steps = std::max(std::abs(toX - fromX), std::abs(toY - fromY));
+
+	// Above the world is open air. A streaming world only holds a window of
+	// the world, so a particle leaving it any way but up is lost.
+	auto Open = [&](int x, int y) { return y < 0 || !occupancy.Test(x, y); };
+	int openX = fromX;
+	int openY = fromY;
+	bool hasOpen = InBounds(fromX, fromY) && Open(fromX, fromY);
+
+	for (int step = 1; step <= steps; ++step)
+	{
+		int x = fromX + int(std::lround(float((toX - fromX) * step) / float(steps)));
+		int y = fromY + int(std::lround(float((toY - fromY) * step) / float(steps)));
+		if (x < 0 || x >= worldWidth || (y >= worldHeight && IsStreaming()))
+			return true;
+		if (y < worldHeight && Open(x, y))
+		{
+			hasOpen = true;
+			openX = x;
+			openY = y;
+			continue;
+		}
+
+		// Where it was has filled up since, with another landing perhaps,
+		// so it goes on top of whatever is there now
+		if (!hasOpen && InBounds(fromX, fromY))
+		{
+			openX = fromX;
+			openY = fromY;
+			while (openY >= 0 && !Open(openX, openY))
+				--openY;
+			hasOpen = true;
+		}
+
+		// Its column is full right to the top, so there is no room for it
+		if (!hasOpen || openY < 0)
+			return true;
+
+		SetCell(openX, openY, flying.material[i], flying.color[i]);
+		int index = Index(openX, openY);
+		velocities[index] = uint8_t(std::min(std::max(int(flying.vy[i] * velocityScale), 0), int(terminalVelocity)));
+		masses[index] = flying.mass[i];
+		return true;
+	}
+	return false;
+}
+
+// Particles are drawn over the grid, wherever the camera shows their cell
+void Simulation::DrawFlying(const Camera& camera, olc::Pixel* view, const olc::DirtyRegion& region) const
+{
+	int size = std::max(camera.ToPixels(1), 1);
+	for (size_t i = 0; i < flying.Size(); ++i)
+	{
+		int cx = int(std::floor(flying.x[i])) - camera.x;
+		int cy = int(std::floor(flying.y[i])) - camera.y;
+		if (cx < 0 || cy < 0)
+			continue;
+		// Zoomed out, a pixel shows the first cell of the ones it covers
+		if (camera.zoom < 0 && ((cx | cy) & ((1 << -camera.zoom) - 1)) != 0)
+			continue;
+
+		int sx = camera.ToPixels(cx);
+		int sy = camera.ToPixels(cy);
+		for (const auto& r : region.vRects)
+		{
+			int x0 = std::max(sx, int(r.x0));
+			int y0 = std::max(sy, int(r.y0));
+			int x1 = std::min(sx + size, int(r.x1));
+			int y1 = std::min(sy + size, int(r.y1));
+			for (int py = y0; py < y1; ++py)
+				std::fill(view + size_t(py) * camera.width + x0, view + size_t(py) * camera.width + std::max(x1, x0), flying.color[i]);
+		}
+	}
+}
@@ -0,0 +1,306 @@
+#include "simulation.h"
+#include <cmath>
+
+// Water as mass. Each cell holds an amount of water and every tick hands
+// some of it on: down as far as the cell below can take, then a share of
+// the difference to either side, and whatever is left over a full cell back
+// up, which is how pressure carries water up the far side of a U bend. A
+// cell under a column of water holds slightly more than a full cell, so the
+// levels have a gradient for the flow up to follow.
+//
+// A tick works out every cell's flows from the masses, then applies them,
+// so both passes are plain loops over rows of floats with no cell reading
+// what another writes. Bands of chunk rows run in parallel, and only the
+// chunks that are awake and their neighbours take part.
+//
+// Levels even out by each cell sharing with the next, which spreads like
+// heat does, so a wide pool takes far longer to settle than it does as
+// whole cells, and keeps its chunks awake meanwhile.
+//
+// Other materials are walls to the water. Heavier ones still sink through
+// it as whole cells, trading places with the water and its mass.
+
+namespace
+{
+	// How much water the lower of two cells holds when they share total
+	// between them and settle: a full cell, plus a little under a thin
+	// layer, and half of it all under a deep one. Each case is the largest
+	// of the three where it applies, so there is no branch to take. Takes
+	// 1 / (full + compress) as well, to multiply instead of divide.
+	inline float StableBelow(float total, float full, float compress, float inverse)
+	{
+		float shallow = (full * full + total * compress) * inverse;
+		float deep = (total + compress) * 0.5f;
+		return std::max(full, std::max(shallow, deep));
+	}
+
+	// The constants of the flow rule, as plain values for the loops
+	struct FlowRule
+	{
+		float full;
+		float compress;
+		float inverse;
+		float damped;
+		float fastest;
+		float least;
+	};
+
+	// Flows out of n cells, given their row and the rows above and below
+	// padded by a cell at each end, each with a mask of 1 where water may
+	// go. Every choice is a min or a max, and no row overlaps another, so
+	// the loop vectorizes.
+	void FlowCells(int n, const float* __restrict above, const float* __restrict here, const float* __restrict below,
+		const float* __restrict openAbove, const float* __restrict openHere, const float* __restrict openBelow,
+		float* __restrict down, float* __restrict left, float* __restrict right, float* __restrict up, FlowRule rule)
+	{
+		// A flow up or down over damped is halved, down to no less than
+		// damped. Sideways a cell gives a quarter of what it has over each
+		// neighbour.
+		auto Damp = [&](float flow) { return std::min(flow, std::max(rule.damped, flow * 0.5f)); };
+		// Any flow under least is dropped
+		auto Least = [&](float flow) { return flow >= rule.least ? flow : 0.0f; };
+
+		for (int i = 0; i < n; ++i)
+		{
+			int c = i + 1;
+			float mass = here[c] * openHere[c];
+			float remaining = mass;
+
+			float flow = Damp(StableBelow(remaining + below[c], rule.full, rule.compress, rule.inverse) - below[c]);
+			flow = Least(std::min(flow, std::min(rule.fastest, remaining))) * openBelow[c];
+			down[i] = flow;
+			remaining -= flow;
+
+			flow = (mass - here[c - 1]) * 0.25f;
+			flow = Least(std::min(flow, remaining)) * openHere[c - 1];
+			left[i] = flow;
+			remaining -= flow;
+
+			flow = (mass - here[c + 1]) * 0.25f;
+			flow = Least(std::min(flow, remaining)) * openHere[c + 1];
+			right[i] = flow;
+			remaining -= flow;
+
+			flow = Damp(remaining - StableBelow(remaining + above[c], rule.full, rule.compress, rule.inverse));
+			flow = Least(std::min(flow, std::min(rule.fastest, remaining))) * openAbove[c];
+			up[i] = flow;
+		}
+	}
+
+	// Adds what flows into n cells and takes away what flows out of them,
+	// keeping each cell's change. The flows in are padded as in FlowCells.
+	void SumFlows(int n, const float* __restrict fromAbove, const float* __restrict fromBelow,
+		const float* __restrict toLeft, const float* __restrict toRight,
+		const float* __restrict down, const float* __restrict left, const float* __restrict right, const float* __restrict up,
+		float* __restrict mass, float* __restrict change)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			int c = i + 1;
+			float inflow = fromAbove[c] + fromBelow[c] + toRight[c - 1] + toLeft[c + 1];
+			float outflow = down[i] + left[i] + right[i] + up[i];
+			change[i] = inflow - outflow;
+			mass[i] += change[i];
+		}
+	}
+}
+
+void Simulation::SetWaterModel(WaterModel model)
+{
+	waterModel = model;
+	massMaterial = model == WaterModel::Mass ? uint8_t(MaterialId::Water) : uint8_t(MaterialId::Empty);
+	if (model == WaterModel::Cells)
+	{
+		for (size_t i = 0; i < masses.size(); ++i)
+			masses[i] = materials[i] == MaterialId::Water ? 1.0f : 0.0f;
+		for (size_t i = 0; i < flying.Size(); ++i)
+			flying.mass[i] = flying.material[i] == MaterialId::Water ? 1.0f : 0.0f;
+	}
+
+	// Water that rested under one model may move under the other
+	if (!chunks.empty())
+		WakeRect(0, 0, worldWidth - 1, worldHeight - 1);
+}
+
+// Returns the number of cells holding water once the flows are applied
+int Simulation::StepFluid(uint64_t tickSeed)
+{
+	if (waterModel != WaterModel::Mass)
+		return 0;
+
+	olc::TraceScope traceFluid("Fluid");
+	if (flowDown.size() != masses.size())
+	{
+		flowDown.assign(masses.size(), 0.0f);
+		flowLeft.assign(masses.size(), 0.0f);
+		flowRight.assign(masses.size(), 0.0f);
+		flowUp.assign(masses.size(), 0.0f);
+	}
+	// Water flows in the awake chunks and those next to them, so it spreads
+	// into a sleeping chunk however little it changes there
+	FlagAwakeNeighbourhood(fluidChunks);
+
+	// Padded rows of the chunk being worked on, see FlowRow and ApplyFlowRow
+	constexpr size_t scratchSize = 6 * (chunkSize + 2);
+
+	threadPool.ParallelFor(chunksY, [&](int cy)
+	{
+		olc::TraceScope traceBand("Flow", cy);
+		float scratch[scratchSize];
+		for (int cx = 0; cx < chunksX; ++cx)
+		{
+			const Chunk& chunk = chunks[cy * chunksX + cx];
+			if (!fluidChunks[cy * chunksX + cx])
+				continue;
+			for (int y = chunk.y; y < chunk.y + chunk.height; ++y)
+				FlowRow(y, chunk.x, chunk.x + chunk.width, scratch);
+		}
+	});
+
+	std::atomic<int> wetCells{ 0 };
+	threadPool.ParallelFor(chunksY, [&](int cy)
+	{
+		olc::TraceScope traceBand("Apply flow", cy);
+		float scratch[scratchSize];
+		for (int cx = 0; cx < chunksX; ++cx)
+		{
+			int index = cy * chunksX + cx;
+			const Chunk& chunk = chunks[index];
+			if (!fluidChunks[index])
+				continue;
+
+			// Streams past the chunk count are the fluid's own
+			Random rng(tickSeed, uint64_t(chunks.size() + index));
+			int minX = INT_MAX, minY = INT_MAX;
+			int maxX = INT_MIN, maxY = INT_MIN;
+			int wet = 0;
+			for (int y = chunk.y; y < chunk.y + chunk.height; ++y)
+			{
+				if (!ApplyFlowRow(y, chunk.x, chunk.x + chunk.width, scratch, rng, minX, maxX, wet))
+					continue;
+				minY = std::min(minY, y);
+				maxY = y;
+			}
+			if (minX <= maxX)
+				WakeRect(minX, minY, maxX, maxY);
+			wetCells += wet;
+		}
+	});
+	return wetCells;
+}
+
+// Works out the flows out of the cells of row y in [x0, x1)
+void Simulation::FlowRow(int y, int x0, int x1, float* scratch)
+{
+	int n = x1 - x0;
+	float* above = scratch;
+	float* here = above + n + 2;
+	float* below = here + n + 2;
+	float* openAbove = below + n + 2;
+	float* openHere = openAbove + n + 2;
+	float* openBelow = openHere + n + 2;
+	LoadFluidRow(masses, y - 1, x0, x1, above);
+	LoadFluidRow(masses, y, x0, x1, here);
+	LoadFluidRow(masses, y + 1, x0, x1, below);
+	LoadOpenRow(y - 1, x0, x1, openAbove);
+	LoadOpenRow(y, x0, x1, openHere);
+	LoadOpenRow(y + 1, x0, x1, openBelow);
+
+	int row = Index(x0, y);
+	FlowRule rule = { maxMass, maxCompress, 1.0f / (maxMass + maxCompress), minFlow, maxFlow, leastFlow };
+	FlowCells(n, above, here, below, openAbove, openHere, openBelow,
+		flowDown.data() + row, flowLeft.data() + row, flowRight.data() + row, flowUp.data() + row, rule);
+}
+
+// Applies the flows in and out of the cells of row y in [x0, x1), turning
+// cells that filled into water and those that drained into empty ones.
+// Returns true if any cell changed enough to keep its chunk awake, and
+// grows [wakeMin, wakeMax] to cover them. Adds the cells left holding
+// water to wetCells.
+bool Simulation::ApplyFlowRow(int y, int x0, int x1, float* scratch, Random& rng, int& wakeMin, int& wakeMax, int& wetCells)
+{
+	int n = x1 - x0;
+	float* fromAbove = scratch;
+	float* fromBelow = fromAbove + n + 2;
+	float* toLeft = fromBelow + n + 2;
+	float* toRight = toLeft + n + 2;
+	float* change = toRight + n + 2;
+	LoadFluidRow(flowDown, y - 1, x0, x1, fromAbove);
+	LoadFluidRow(flowUp, y + 1, x0, x1, fromBelow);
+	LoadFluidRow(flowLeft, y, x0, x1, toLeft);
+	LoadFluidRow(flowRight, y, x0, x1, toRight);
+
+	int row = Index(x0, y);
+	float* mass = masses.data() + row;
+	SumFlows(n, fromAbove, fromBelow, toLeft, toRight,
+		flowDown.data() + row, flowLeft.data() + row, flowRight.data() + row, flowUp.data() + row, mass, change);
+
+	const std::vector<olc::Pixel>& palette = registry.Get(MaterialId::Water).palette;
+	const float wet = minMass;
+	const float settled = settleMass;
+	uint8_t stamp = CurrentStamp();
+	bool changed = false;
+	for (int i = 0; i < n; ++i)
+	{
+		int x = x0 + i;
+		uint8_t material = materials[row + i];
+		bool water = material == MaterialId::Water;
+		if (!water && material != MaterialId::Empty)
+			continue;
+		bool flip = water != (mass[i] >= wet);
+		wetCells += mass[i] >= wet;
+		if (!flip && std::abs(change[i]) < settled)
+			continue;
+
+		changed = true;
+		wakeMin = std::min(wakeMin, x);
+		wakeMax = std::max(wakeMax, x);
+		if (!flip)
+			continue;
+
+		// The rows are this band's own, so no other worker writes them
+		materials[row + i] = water ? uint8_t(MaterialId::Empty) : uint8_t(MaterialId::Water);
+		colors[row + i] = water ? olc::BLACK : palette[rng.Below(int(palette.size()))];
+		stamps[row + i] = stamp;
+		velocities[row + i] = 0;
+		occupancy.Assign(x, y, !water);
+	}
+	return changed;
+}
+
+// True if water flows in cell (x, y) this tick, false outside the world
+bool Simulation::IsFlowing(int x, int y) const
+{
+	return x >= 0 && x < worldWidth && y >= 0 && y < worldHeight && fluidChunks[(y / chunkSize) * chunksX + x / chunkSize];
+}
+
+// Copies row y of a plane over [x0 - 1, x1] into out, with nothing outside
+// the world or in chunks whose water is not flowing this tick. [x0, x1) is
+// inside one chunk, so only the two ends need a look of their own.
+void Simulation::LoadFluidRow(const std::vector<float>& plane, int y, int x0, int x1, float* out) const
+{
+	int n = x1 - x0;
+	if (IsFlowing(x0, y))
+		std::copy(plane.data() + Index(x0, y), plane.data() + Index(x1, y), out + 1);
+	else
+		std::fill(out + 1, out + n + 1, 0.0f);
+	out[0] = IsFlowing(x0 - 1, y) ? plane[Index(x0 - 1, y)] : 0.0f;
+	out[n + 1] = IsFlowing(x1, y) ? plane[Index(x1, y)] : 0.0f;
+}
+
+// As LoadFluidRow, 1 where water may flow and 0 elsewhere
+void Simulation::LoadOpenRow(int y, int x0, int x1, float* out) const
+{
+	auto Open = [](uint8_t material) { return material == MaterialId::Empty || material == MaterialId::Water ? 1.0f : 0.0f; };
+	int n = x1 - x0;
+	if (IsFlowing(x0, y))
+	{
+		const uint8_t* row = materials.data() + Index(x0, y);
+		for (int i = 0; i < n; ++i)
+			out[i + 1] = Open(row[i]);
+	}
+	else
+		std::fill(out + 1, out + n + 1, 0.0f);
+	out[0] = IsFlowing(x0 - 1, y) ? Open(materials[Index(x0 - 1, y)]) : 0.0f;
+	out[n + 1] = IsFlowing(x1, y) ? Open(materials[Index(x1, y)]) : 0.0f;
+}
@@ -0,0 +1,273 @@
+#include "simulation.h"
+#include <algorithm>
+#include <cmath>
+
+// Heat. Temperature is kept per block of heatBlock x heatBlock cells, a
+// field a sixteenth the size of the planes, and every tick spreads between
+// neighbouring blocks through a five-point stencil weighted by how well the
+// blocks conduct, while each block drifts slowly back to the ambient
+// temperature. New cells bring their material's temperature with them, and
+// glowing ones such as lava go on drawing their block towards it.
+//
+// As with the water, a tick works the new field out from the old one and
+// then settles it: cells past one of their material's limits turn into
+// another material, a few at a time, and each block's conductivity is
+// measured again. Bands of chunk rows run in parallel, and only the chunks
+// that are awake and their neighbours take part, so a sleeping chunk keeps
+// its temperature until something wakes it.
+
+namespace
+{
+	// New temperatures of n blocks, given their row and the rows above and
+	// below padded by a block at each end, and the same of conductivities,
+	// which are 0 where heat does not flow, and the glow of the n blocks.
+	// Heat crosses between two blocks in proportion to the lower
+	// conductivity of the two. No row overlaps another, so the loop
+	// vectorizes.
+	void DiffuseBlocks(int n, const float* __restrict above, const float* __restrict here, const float* __restrict below,
+		const float* __restrict conductAbove, const float* __restrict conductHere, const float* __restrict conductBelow,
+		const float* __restrict glow, const float* __restrict glowHeat,
+		float* __restrict next, float rate, float ambient, float loss)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			int c = i + 1;
+			float heat = here[c];
+			float conduct = conductHere[c];
+			float flow = std::min(conduct, conductHere[c - 1]) * (here[c - 1] - heat)
+				+ std::min(conduct, conductHere[c + 1]) * (here[c + 1] - heat)
+				+ std::min(conduct, conductAbove[c]) * (above[c] - heat)
+				+ std::min(conduct, conductBelow[c]) * (below[c] - heat);
+			next[i] = heat + rate * flow + loss * (ambient - heat) + glowHeat[i] - glow[i] * heat;
+		}
+	}
+
+	// What settling found out about a block
+	enum : uint8_t
+	{
+		BlockWarmed = 1,
+		BlockPastLimit = 2
+	};
+
+	// Takes on the coming tick's temperatures of n blocks, flagging those
+	// that changed by settle or more and those past a limit of their cells
+	void SettleBlocks(int n, const float* __restrict next, float* __restrict heat,
+		const float* __restrict hotLimit, const float* __restrict coldLimit, float settle, uint8_t* __restrict flags)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			float to = next[i];
+			bool warmed = std::abs(to - heat[i]) >= settle;
+			bool past = to > hotLimit[i] || to < coldLimit[i];
+			flags[i] = uint8_t((warmed ? BlockWarmed : 0) | (past ? BlockPastLimit : 0));
+			heat[i] = to;
+		}
+	}
+}
+
+void Simulation::StepHeat(uint64_t tickSeed)
+{
+	olc::TraceScope traceHeat("Heat");
+	FlagAwakeNeighbourhood(heatChunks);
+
+	// Only the bands holding a chunk whose heat flows are handed out
+	heatRows.clear();
+	for (int cy = 0; cy < chunksY; ++cy)
+		if (std::find(heatChunks.begin() + cy * chunksX, heatChunks.begin() + (cy + 1) * chunksX, 1) != heatChunks.begin() + (cy + 1) * chunksX)
+			heatRows.push_back(cy);
+	if (heatRows.empty())
+		return;
+
+	// Padded rows of the chunk being worked on, see DiffuseRow
+	constexpr int chunkBlocks = chunkSize / heatBlock;
+	constexpr size_t scratchSize = 6 * (chunkBlocks + 2);
+	auto Blocks = [](int from, int size) { return (from + size + heatBlock - 1) / heatBlock; };
+
+	// Cells that may have changed since the last tick, per chunk: those
+	// woken before this tick and those woken during it. Taken before any
+	// block settles, since settling wakes cells in the chunks around.
+	std::fill(heatChanged.begin(), heatChanged.end(), 0);
+
+	threadPool.ParallelFor(int(heatRows.size()), [&](int row)
+	{
+		int cy = heatRows[row];
+		olc::TraceScope traceBand("Diffuse", cy);
+		float scratch[scratchSize];
+		for (int cx = 0; cx < chunksX; ++cx)
+		{
+			int index = cy * chunksX + cx;
+			const Chunk& chunk = chunks[index];
+			if (!heatChunks[index])
+				continue;
+
+			int* area = heatChanged.data() + index * 4;
+			area[0] = std::min(chunk.minX, chunk.nextMinX.load());
+			area[1] = std::min(chunk.minY, chunk.nextMinY.load());
+			area[2] = std::max(chunk.maxX, chunk.nextMaxX.load());
+			area[3] = std::max(chunk.maxY, chunk.nextMaxY.load());
+			for (int by = chunk.y / heatBlock; by < Blocks(chunk.y, chunk.height); ++by)
+				DiffuseRow(by, chunk.x / heatBlock, Blocks(chunk.x, chunk.width), scratch);
+		}
+	});
+
+	threadPool.ParallelFor(int(heatRows.size()), [&](int row)
+	{
+		int cy = heatRows[row];
+		olc::TraceScope traceBand("Settle heat", cy);
+		for (int cx = 0; cx < chunksX; ++cx)
+		{
+			int index = cy * chunksX + cx;
+			const Chunk& chunk = chunks[index];
+			if (!heatChunks[index])
+				continue;
+
+			// The fluid's streams follow the chunks', and the heat's follow those
+			Random rng(tickSeed, uint64_t(2 * chunks.size() + index));
+			const int* area = heatChanged.data() + index * 4;
+			int minX = INT_MAX, minY = INT_MAX;
+			int maxX = INT_MIN, maxY = INT_MIN;
+			int bx0 = chunk.x / heatBlock;
+			int bx1 = Blocks(chunk.x, chunk.width);
+			for (int by = chunk.y / heatBlock; by < Blocks(chunk.y, chunk.height); ++by)
+			{
+				int first = by * heatWidth + bx0;
+				uint8_t flags[chunkBlocks];
+				SettleBlocks(bx1 - bx0, nextTemperatures.data() + first, temperatures.data() + first,
+					hotLimits.data() + first, coldLimits.data() + first, settleHeat, flags);
+
+				// Only blocks whose cells may change need a look at them
+				int y0 = by * heatBlock;
+				bool rowChanged = y0 + heatBlock > area[1] && y0 <= area[3];
+				for (int bx = bx0; bx < bx1; ++bx)
+				{
+					int x0 = bx * heatBlock;
+					uint8_t flag = flags[bx - bx0];
+					bool changedCells = rowChanged && x0 + heatBlock > area[0] && x0 <= area[2];
+					if (changedCells || (flag & BlockPastLimit))
+						ChangeBlock(bx, by, changedCells, rng);
+					if (!(flag & BlockWarmed))
+						continue;
+					minX = std::min(minX, x0);
+					minY = std::min(minY, y0);
+					maxX = std::max(maxX, x0 + heatBlock - 1);
+					maxY = std::max(maxY, y0 + heatBlock - 1);
+				}
+			}
+			if (minX <= maxX)
+				WakeRect(minX, minY, std::min(maxX, worldWidth - 1), std::min(maxY, worldHeight - 1));
+		}
+	});
+}
+
+// Works out the coming tick's temperatures of the blocks of row by in [bx0, bx1)
+void Simulation::DiffuseRow(int by, int bx0, int bx1, float* scratch)
+{
+	int n = bx1 - bx0;
+	float* above = scratch;
+	float* here = above + n + 2;
+	float* below = here + n + 2;
+	float* conductAbove = below + n + 2;
+	float* conductHere = conductAbove + n + 2;
+	float* conductBelow = conductHere + n + 2;
+	LoadHeatRow(temperatures, by - 1, bx0, bx1, above);
+	LoadHeatRow(temperatures, by, bx0, bx1, here);
+	LoadHeatRow(temperatures, by + 1, bx0, bx1, below);
+	LoadHeatRow(conductivities, by - 1, bx0, bx1, conductAbove);
+	LoadHeatRow(conductivities, by, bx0, bx1, conductHere);
+	LoadHeatRow(conductivities, by + 1, bx0, bx1, conductBelow);
+
+	int row = by * heatWidth + bx0;
+	DiffuseBlocks(n, above, here, below, conductAbove, conductHere, conductBelow, glows.data() + row, glowHeats.data() + row,
+		nextTemperatures.data() + row, heatRate, ambientTemperature, ambientRate);
+}
+
+// Changes the cells of block (bx, by) that are past their limits, first
+// measuring the block again if its cells may have changed since it last
+// was. Changed cells wake themselves.
+void Simulation::ChangeBlock(int bx, int by, bool changedCells, Random& rng)
+{
+	int index = by * heatWidth + bx;
+	float heat = temperatures[index];
+	if (changedCells)
+		MeasureBlock(bx, by);
+	if (heat <= hotLimits[index] && heat >= coldLimits[index])
+		return;
+
+	// The block's rows are this band's own, so no other worker writes them
+	int x0 = bx * heatBlock;
+	int y0 = by * heatBlock;
+	int x1 = std::min(x0 + heatBlock, worldWidth);
+	int y1 = std::min(y0 + heatBlock, worldHeight);
+	bool transformed = false;
+	for (int y = y0; y < y1; ++y)
+		for (int x = x0; x < x1; ++x)
+		{
+			// A falling cell is only passing through, too briefly to take on
+			// the heat of the block
+			int cell = Index(x, y);
+			uint8_t material = materials[cell];
+			uint8_t into = registry.Transform(material, heat);
+			if (into == material || velocities[cell] != 0 || rng.Below(phaseOdds) != 0)
+				continue;
+			const std::vector<olc::Pixel>& palette = registry.Get(into).palette;
+			SetCell(x, y, into, palette[rng.Below(int(palette.size()))]);
+			transformed = true;
+		}
+
+	if (transformed)
+		MeasureBlock(bx, by);
+}
+
+// Works out the conductivity, glow and limits of block (bx, by) from its cells
+void Simulation::MeasureBlock(int bx, int by)
+{
+	int x0 = bx * heatBlock;
+	int y0 = by * heatBlock;
+	int x1 = std::min(x0 + heatBlock, worldWidth);
+	int y1 = std::min(y0 + heatBlock, worldHeight);
+	float conduct = 0.0f;
+	float glow = 0.0f;
+	float glowHeat = 0.0f;
+	float hot = FLT_MAX;
+	float cold = -FLT_MAX;
+	for (int y = y0; y < y1; ++y)
+		for (int x = x0; x < x1; ++x)
+		{
+			uint8_t material = materials[Index(x, y)];
+			conduct += registry.GetConductivity(material);
+			glow += registry.GetGlow(material);
+			glowHeat += registry.GetGlow(material) * registry.GetTemperature(material);
+			hot = std::min(hot, registry.GetHotAt(material));
+			cold = std::max(cold, registry.GetColdAt(material));
+		}
+
+	int index = by * heatWidth + bx;
+	float cells = float((x1 - x0) * (y1 - y0));
+	conductivities[index] = conduct / cells;
+	glows[index] = glow / cells;
+	glowHeats[index] = glowHeat / cells;
+	hotLimits[index] = hot;
+	coldLimits[index] = cold;
+}
+
+// True if heat flows in block (bx, by) this tick, false outside the world
+bool Simulation::IsHeating(int bx, int by) const
+{
+	return bx >= 0 && bx < heatWidth && by >= 0 && by < heatHeight &&
+		heatChunks[(by * heatBlock / chunkSize) * chunksX + bx * heatBlock / chunkSize];
+}
+
+// Copies row by of a block plane over [bx0 - 1, bx1] into out, with nothing
+// outside the world or in chunks whose heat is not flowing this tick.
+// [bx0, bx1) is inside one chunk, so only the two ends need a look of their own.
+void Simulation::LoadHeatRow(const std::vector<float>& plane, int by, int bx0, int bx1, float* out) const
+{
+	int n = bx1 - bx0;
+	int row = by * heatWidth;
+	if (IsHeating(bx0, by))
+		std::copy(plane.data() + row + bx0, plane.data() + row + bx1, out + 1);
+	else
+		std::fill(out + 1, out + n + 1, 0.0f);
+	out[0] = IsHeating(bx0 - 1, by) ? plane[row + bx0 - 1] : 0.0f;
+	out[n + 1] = IsHeating(bx1, by) ? plane[row + bx1] : 0.0f;
+}
@@ -1,10 +1,102 @@
 #include "game.h"
+#include <cctype>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 
-int main()
+int main(int argc, char* argv[])
 {
-	Game game;
-	if (game.Construct(240, 160, 3, 3, false, true))
+	// "--headless [N]" runs N frames without a window, for servers and benchmarks.
+	// "--trace file" records the whole run as a Chrome trace.
+	// "--record file" saves the input of the session, "--replay file" plays
+	// one back in place of the mouse and keyboard and ends with it. Both run
+	// one tick per frame so a replay reproduces the recorded world exactly,
+	// given the same world size.
+	// "--size WxH" sets the size of the world, which can be far larger than
+	// the screen.
+	// "--stream dir" makes the world unbounded, with --size cells of it in
+	// memory around the camera and the rest stored in dir.
+	bool headless = false;
+	uint32_t frames = 0;
+	bool framesGiven = false;
+	const char* traceFile = nullptr;
+	const char* recordFile = nullptr;
+	const char* replayFile = nullptr;
+	olc::vi2d worldSize = { 1024, 512 };
+	const char* streamDirectory = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+		{
+			headless = true;
+			if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+			{
+				frames = uint32_t(strtoul(argv[++i], nullptr, 10));
+				framesGiven = true;
+			}
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			traceFile = argv[++i];
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			recordFile = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replayFile = argv[++i];
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+		{
+			int width = 0, height = 0;
+			if (sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+				worldSize = { width, height };
+		}
+		else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+			streamDirectory = argv[++i];
+	}
+
+	// Without a count a headless replay runs to the end of the recording
+	if (headless && !framesGiven && !replayFile)
+		frames = 600;
+
+	if (traceFile)
+		olc::Trace::Start();
+
+	uint64_t seed = uint64_t(time(NULL));
+	olc::InputRecording recording;
+	if (replayFile)
+	{
+		if (recording.Load(replayFile) != olc::OK)
+		{
+			fprintf(stderr, "Could not load %s\n", replayFile);
+			return 1;
+		}
+		seed = recording.nSeed;
+	}
+
+	Game game(seed, worldSize, headless || recordFile || replayFile);
+	if (streamDirectory)
+		game.StreamFrom(streamDirectory);
+	if (replayFile)
+		game.StartInputReplay(replayFile);
+	else if (recordFile)
+		game.StartInputRecording(seed);
+
+	if (game.Construct(240, 160, 3, 3, false, true, headless))
+	{
+		game.SetFrameLimit(frames);
 		game.Start();
+	}
+
+	if (recordFile && game.SaveInputRecording(recordFile) != olc::OK)
+		fprintf(stderr, "Could not save %s\n", recordFile);
+
+	if (headless || replayFile)
+		printf("tick %" PRIu64 " world hash %016" PRIx64 "\n", game.GetTick(), game.GetWorldHash());
+
+	if (traceFile)
+	{
+		olc::Trace::Stop();
+		olc::Trace::Save(traceFile);
+	}
 
 	return 0;
 }
@@ -0,0 +1,68 @@
+#include "material.h"
+#include <cassert>
+
+MaterialRegistry::MaterialRegistry()
+{
+	// Name, movement, density, flammability, palette, then the heat
+	// properties: conductivity, starting temperature, what the material
+	// turns into above and below its limits, and glow, then lifetime
+	Register({ "Empty", MovementClass::Static, 0, 0.0f, { olc::BLACK }, 0.02f });
+
+	Register({ "Sand", MovementClass::Powder, 160, 0.0f,
+		{ { 237, 200, 85 }, { 242, 209, 107 }, { 230, 198, 101 }, { 232, 194, 74 } },
+		0.2f, ambientTemperature, 900.0f, MaterialId::Glass });
+
+	Register({ "Water", MovementClass::Liquid, 100, 0.0f,
+		{ { 0, 153, 255 }, { 14, 143, 230 }, { 28, 150, 232 }, { 5, 144, 237 } },
+		0.6f, ambientTemperature, 100.0f, MaterialId::Steam, 0.0f, MaterialId::Ice });
+
+	Register({ "Stone", MovementClass::Static, 255, 0.0f,
+		{ { 110, 110, 115 }, { 120, 118, 122 }, { 98, 99, 104 }, { 128, 126, 131 } },
+		0.3f });
+
+	Register({ "Oil", MovementClass::Liquid, 80, 0.9f,
+		{ { 66, 50, 32 }, { 74, 56, 36 }, { 60, 46, 30 }, { 80, 61, 40 } },
+		0.15f, ambientTemperature, 300.0f, MaterialId::Smoke });
+
+	Register({ "Smoke", MovementClass::Gas, 1, 0.0f,
+		{ { 90, 90, 90 }, { 100, 100, 100 }, { 84, 84, 88 }, { 108, 106, 106 } },
+		0.05f, ambientTemperature, FLT_MAX, 0, -FLT_MAX, 0, 0.0f, 600 });
+
+	Register({ "Steam", MovementClass::Gas, 2, 0.0f,
+		{ { 200, 210, 220 }, { 214, 222, 230 }, { 190, 200, 212 }, { 224, 230, 236 } },
+		0.1f, 120.0f, FLT_MAX, 0, 90.0f, MaterialId::Water, 0.0f, 1500 });
+
+	Register({ "Ice", MovementClass::Static, 255, 0.0f,
+		{ { 170, 220, 250 }, { 180, 228, 252 }, { 160, 212, 246 }, { 190, 232, 255 } },
+		0.8f, -20.0f, 0.0f, MaterialId::Water });
+
+	Register({ "Glass", MovementClass::Static, 255, 0.0f,
+		{ { 200, 230, 225 }, { 188, 222, 218 }, { 210, 236, 232 }, { 180, 214, 210 } },
+		0.3f });
+
+	Register({ "Lava", MovementClass::Liquid, 200, 0.0f,
+		{ { 255, 90, 20 }, { 240, 70, 10 }, { 255, 120, 30 }, { 230, 60, 15 } },
+		0.5f, 1200.0f, FLT_MAX, 0, 700.0f, MaterialId::Stone, 0.1f });
+
+	assert(GetCount() == MaterialId::BuiltInCount);
+}
+
+uint8_t MaterialRegistry::Register(const Material& material)
+{
+	assert(GetCount() < maxMaterials);
+	assert(!material.palette.empty());
+
+	uint8_t id = uint8_t(definitions.size());
+	definitions.push_back(material);
+	movement[id] = material.movement;
+	density[id] = material.density;
+	conductivity[id] = material.conductivity;
+	temperature[id] = material.temperature;
+	hotAt[id] = material.hotAt;
+	hotInto[id] = material.hotInto;
+	coldAt[id] = material.coldAt;
+	coldInto[id] = material.coldInto;
+	glow[id] = material.glow;
+	lifetime[id] = material.lifetime;
+	return id;
+}
@@ -1,169 +1,560 @@
 #include "simulation.h"
 
 
-int randomRange(int min, int max) //range : [min, max)
+void Simulation::CreateObject(int x, int y, uint8_t material)
 {
-	return min + rand() % ((max + 1) - min);
+	if (x >= 0 && x < worldWidth && y >= 0 && y < worldHeight && material < registry.GetCount())
+	{
+		const std::vector<olc::Pixel>& palette = registry.Get(material).palette;
+		SetCell(x, y, material, palette[mainRandom.Below(int(palette.size()))]);
+		AddHeat(x, y, material);
+	}
 }
 
-void Simulation::CreateObject(int x, int y, int objectType)
+void Simulation::InitSimulation(int width, int height)
 {
-	//createdObjects.push_back({ x, y });
-	if (x > 0 && x < screenWidth && y > 0 && y < screenHeight)
+	worldWidth = width;
+	worldHeight = height;
+
+	materials.assign(worldWidth * worldHeight, 0);
+	colors.assign(worldWidth * worldHeight, olc::BLACK);
+	stamps.assign(worldWidth * worldHeight, 0);
+	velocities.assign(worldWidth * worldHeight, 0);
+	masses.assign(worldWidth * worldHeight, 0.0f);
+	flowDown.clear();
+	flowLeft.clear();
+	flowRight.clear();
+	flowUp.clear();
+	heatWidth = (worldWidth + heatBlock - 1) / heatBlock;
+	heatHeight = (worldHeight + heatBlock - 1) / heatBlock;
+	temperatures.assign(size_t(heatWidth) * heatHeight, ambientTemperature);
+	nextTemperatures.assign(temperatures.size(), ambientTemperature);
+	conductivities.assign(temperatures.size(), registry.GetConductivity(MaterialId::Empty));
+	glows.assign(temperatures.size(), 0.0f);
+	glowHeats.assign(temperatures.size(), 0.0f);
+	hotLimits.assign(temperatures.size(), FLT_MAX);
+	coldLimits.assign(temperatures.size(), -FLT_MAX);
+	occupancy.Reset(worldWidth, worldHeight, maxReach);
+
+	chunksX = (worldWidth + chunkSize - 1) / chunkSize;
+	chunksY = (worldHeight + chunkSize - 1) / chunkSize;
+	chunks = std::vector<Chunk>(chunksX * chunksY);
+	launches.assign(chunks.size(), FlyingParticles());
+	risingCells.assign(chunks.size(), std::vector<olc::vi2d>());
+	fadingChunks.assign(chunks.size(), 0);
+	heatChanged.assign(chunks.size() * 4, 0);
+	flying.Clear();
+	for (int cy = 0; cy < chunksY; ++cy)
 	{
-		olc::Pixel color;
+		for (int cx = 0; cx < chunksX; ++cx)
+		{
+			Chunk& chunk = chunks[cy * chunksX + cx];
+			chunk.x = cx * chunkSize;
+			chunk.y = cy * chunkSize;
+			chunk.width = std::min(int(chunkSize), worldWidth - chunk.x);
+			chunk.height = std::min(int(chunkSize), worldHeight - chunk.y);
+		}
+	}
+}
+
+int Simulation::GetAwakeChunkCount() const
+{
+	int count = 0;
+	for (const Chunk& chunk : chunks)
+		if (chunk.IsAwake())
+			++count;
+	return count;
+}
+
+void Simulation::FlagAwakeNeighbourhood(std::vector<uint8_t>& flags) const
+{
+	flags.assign(chunks.size(), 0);
+	for (int cy = 0; cy < chunksY; ++cy)
+		for (int cx = 0; cx < chunksX; ++cx)
+		{
+			if (!chunks[cy * chunksX + cx].IsAwake())
+				continue;
+			for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, chunksY - 1); ++ny)
+				for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, chunksX - 1); ++nx)
+					flags[ny * chunksX + nx] = 1;
+		}
+}
 
-		if (objectType == 1)
+// After a tick the rectangle of every chunk covers all cells changed since
+// the previous tick, whether by moves or by brushes, so the chunks double as
+// the region of the color plane to redraw
+void Simulation::CollectDirtyRegion(olc::DirtyRegion& region) const
+{
+	for (const Chunk& chunk : chunks)
+		if (chunk.IsAwake())
+			region.Add(chunk.minX, chunk.minY, chunk.maxX - chunk.minX + 1, chunk.maxY - chunk.minY + 1);
+	if (flightMinX <= flightMaxX)
+		region.Add(flightMinX, flightMinY, flightMaxX - flightMinX + 1, flightMaxY - flightMinY + 1);
+}
+
+void Simulation::DrawView(const Camera& camera, olc::Pixel* view, const olc::DirtyRegion& region) const
+{
+	for (const auto& r : region.vRects)
+	{
+		for (int sy = r.y0; sy < r.y1; ++sy)
 		{
-			switch (randomRange(0, 3))
+			olc::Pixel* out = view + size_t(sy) * camera.width;
+			int wy = camera.y + camera.ToCells(sy);
+			if (wy < 0 || wy >= worldHeight)
 			{
-				case 0:
-					color = olc::Pixel{ 237, 200, 85 };
-					break;
-				case 1:
-					color = olc::Pixel{ 242, 209, 107 };
-					break;
-				case 2:
-					color = olc::Pixel{ 230, 198, 101 };
-					break;
-				case 3:
-					color = olc::Pixel{ 232, 194, 74 };
-					break;
+				std::fill(out + r.x0, out + r.x1, olc::BLACK);
+				continue;
 			}
 
+			const olc::Pixel* row = colors.data() + size_t(wy) * worldWidth;
+			if (camera.zoom == 0)
+			{
+				// One cell per pixel, a straight copy of the part inside the world
+				int x0 = std::max(r.x0, -camera.x);
+				int x1 = std::max(std::min(r.x1, worldWidth - camera.x), x0);
+				if (x0 >= r.x1)
+					x0 = x1 = r.x1;
+				std::fill(out + r.x0, out + x0, olc::BLACK);
+				std::copy(row + camera.x + x0, row + camera.x + x1, out + x0);
+				std::fill(out + x1, out + r.x1, olc::BLACK);
+				continue;
+			}
 
-		}
-		else
-		{
-			switch (randomRange(0, 3))
+			for (int sx = r.x0; sx < r.x1; ++sx)
 			{
-			case 0:
-				color = olc::Pixel{ 0, 153, 255 };
-				break;
-			case 1:
-				color = olc::Pixel{ 14, 143, 230 };
-				break;
-			case 2:
-				color = olc::Pixel{ 28, 150, 232 };
-				break;
-			case 3:
-				color = olc::Pixel{ 5, 144, 237 };
-				break;
+				int wx = camera.x + camera.ToCells(sx);
+				out[sx] = wx >= 0 && wx < worldWidth ? row[wx] : olc::BLACK;
 			}
 		}
+	}
+
+	DrawFlying(camera, view, region);
+}
+
+// Marks the area around a changed cell for processing on the next tick. The
+// area may straddle a chunk border, which is how sleeping neighbours wake up.
+void Simulation::WakeCell(int x, int y)
+{
+	WakeRect(x, y, x, y);
+}
+
+// As WakeCell, for every cell of [x0, x1] x [y0, y1]
+void Simulation::WakeRect(int x0, int y0, int x1, int y1)
+{
+	x0 = std::max(x0 - wakeMargin, 0);
+	y0 = std::max(y0 - wakeMargin, 0);
+	x1 = std::min(x1 + wakeMargin, worldWidth - 1);
+	y1 = std::min(y1 + wakeMargin, worldHeight - 1);
+
+	for (int cy = y0 / chunkSize; cy <= y1 / chunkSize; ++cy)
+		for (int cx = x0 / chunkSize; cx <= x1 / chunkSize; ++cx)
+			chunks[cy * chunksX + cx].Expand(x0, y0, x1, y1);
+}
+
+
+
+
+uint64_t Simulation::Hash() const
+{
+	// FNV-1a, a byte at a time
+	uint64_t hash = 14695981039346656037ULL;
+	auto Add = [&](const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	};
+
+	Add(&tick, sizeof(tick));
+	Add(materials.data(), materials.size());
+	Add(colors.data(), colors.size() * sizeof(olc::Pixel));
+	Add(velocities.data(), velocities.size());
+	Add(masses.data(), masses.size() * sizeof(float));
+	Add(temperatures.data(), temperatures.size() * sizeof(float));
+	for (const Emitter& emitter : emitters)
+	{
+		int32_t values[5] = { emitter.x, emitter.y, emitter.radius, emitter.material, emitter.rate };
+		Add(values, sizeof(values));
+	}
+	Add(flying.x.data(), flying.Size() * sizeof(float));
+	Add(flying.y.data(), flying.Size() * sizeof(float));
+	Add(flying.vx.data(), flying.Size() * sizeof(float));
+	Add(flying.vy.data(), flying.Size() * sizeof(float));
+	Add(flying.material.data(), flying.Size());
+	Add(flying.mass.data(), flying.Size() * sizeof(float));
+	return hash;
+}
+
+void Simulation::SetSeed(uint64_t seed)
+{
+	worldSeed = seed;
+	tick = 0;
+	mainRandom.Seed(seed);
+}
+
+void Simulation::ProcessSimulation()
+{
+	// Every chunk draws from its own stream, derived from the world seed,
+	// the tick and the chunk index, so the outcome does not depend on
+	// which thread ends up processing it
+	uint64_t tickSeed = Random::Mix(worldSeed ^ Random::Mix(tick));
+	olc::TraceScope traceTick("Tick", int32_t(tick));
+
+	RunEmitters();
+	std::atomic<int> processedCells{ 0 };
+	std::atomic<int> revisitedCells{ 0 };
+
+	// Chunks of one phase are at least one chunk apart, so they can be
+	// updated concurrently. Each phase lists its chunks bottom row first,
+	// which is the order the serial path walks them in.
+	for (int phase = 0; phase < 4; ++phase)
+	{
+		olc::TraceScope tracePhase("Phase", phase);
+		phaseChunks.clear();
+		for (int cy = chunksY - 1 - ((chunksY - 1 + (phase >> 1)) & 1); cy >= 0; cy -= 2)
+			for (int cx = chunksX - 1 - ((chunksX - 1 + (phase & 1)) & 1); cx >= 0; cx -= 2)
+			{
+				int index = cy * chunksX + cx;
+				if (!chunks[index].IsAwake())
+					continue;
+				phaseChunks.push_back(index);
+				fadingChunks[index] = 1;
+			}
+
+		threadPool.ParallelFor(int(phaseChunks.size()), [&](int i)
+		{
+			olc::TraceScope traceChunk("Chunk", phaseChunks[i]);
+			Random rng(tickSeed, uint64_t(phaseChunks[i]));
+			TickStats stats = ProcessChunk(chunks[phaseChunks[i]], rng);
+			processedCells += stats.processedCells;
+			revisitedCells += stats.revisitedCells;
+		});
+	}
+
+	// Landings, flows, changes of heat and fading wake their cells, so they
+	// all come before the chunks step
+	FadeCells(tickSeed);
+	processedCells += StepFluid(tickSeed);
+	StepHeat(tickSeed);
+	StepFlight();
+	for (Chunk& chunk : chunks)
+		chunk.Step();
+
+	tickStats.processedCells = processedCells;
+	tickStats.revisitedCells = revisitedCells;
+	tickStats.flyingParticles = int(flying.Size());
+
+	++tick;
+}
+
+// Falls a cell that can enter the one below it, speeding up on the way.
+// Returns false if it cannot.
+bool Simulation::Fall(int x, int y, uint8_t material, Random& rng)
+{
+	// A cell held up by another keeps no more than that one's speed, which
+	// is nothing once it rests and what it fell this tick while falling
+	int index = Index(x, y);
+	if (!CanEnter(material, x, y + 1))
+	{
+		int below = y + 1 < worldHeight ? velocities[Index(x, y + 1)] : 0;
+		velocities[index] = uint8_t(std::min(int(velocities[index]), below));
+		return false;
+	}
+
+	// Landing fast in a liquid throws the liquid up out of the grid. The
+	// list is that of the chunk holding (x, y), which is the one being
+	// processed.
+	int below = Index(x, y + 1);
+	if (velocities[index] >= splashVelocity && registry.GetMovement(materials[below]) == MovementClass::Liquid)
+	{
+		float speed = float(velocities[index]) / velocityScale;
+		FlyingParticles& list = launches[(y / chunkSize) * chunksX + x / chunkSize];
+		Launch(list, x, y + 1, (rng.Float() - 0.5f) * speed, -speed * (0.3f + 0.4f * rng.Float()));
+		MoveCell(x, y, x, y + 1);
+		velocities[below] = uint8_t(velocityScale);
+		return true;
+	}
+
+	// Sinking through something lighter is one cell at a time, and the
+	// drag keeps it slow
+	if (!IsEmpty(x, y + 1))
+	{
+		int velocity = std::min(int(velocities[index]), int(velocityScale));
+		SwapCells(x, y, x, y + 1);
+		velocities[Index(x, y + 1)] = uint8_t(velocity);
+		return true;
+	}
 
+	// The path is straight down, so walking it is one bit of the occupancy
+	// plane per row, up to the first cell holding anything
+	int velocity = std::min(velocities[index] + gravity, int(terminalVelocity));
+	int reach = std::min(std::max(velocity / velocityScale, 1), worldHeight - 1 - y);
+	int distance = 1;
+	while (distance < reach && !occupancy.Test(x, y + distance + 1))
+		++distance;
 
-		
-		world[y * screenWidth + x] = { objectType , color };
+	if (distance < reach)
+	{
+		int landing = y + distance + 1 < worldHeight ? velocities[Index(x, y + distance + 1)] : 0;
+		velocity = std::max(distance * velocityScale, std::min(velocity, landing));
 	}
+	MoveCell(x, y, x, y + distance);
+	velocities[Index(x, y + distance)] = uint8_t(velocity);
+	return true;
+}
+
+//*** Powder: falls, then slides down either side
+template<>
+void Simulation::UpdateCell<MovementClass::Powder>(int x, int y, uint8_t material, Random& rng)
+{
+	if (Fall(x, y, material, rng))
+		return;
 
+	int side = rng.Below(2) ? 1 : -1;
+	if (CanEnter(material, x + side, y + 1))
+		Displace(x, y, x + side, y + 1);
+	else if (CanEnter(material, x - side, y + 1))
+		Displace(x, y, x - side, y + 1);
 }
 
-void Simulation::InitSimulation(int screen_w, int screen_h, int pixel_w, int pixel_h)
+//*** Liquid: falls, slides down either side, then levels out along the row
+template<>
+void Simulation::UpdateCell<MovementClass::Liquid>(int x, int y, uint8_t material, Random& rng)
 {
-	screenWidth = screen_w;
-	screenHeight = screen_h;
+	if (Fall(x, y, material, rng))
+		return;
+
+	int side = rng.Below(2) ? 1 : -1;
+	if (CanEnter(material, x + side, y + 1))
+	{
+		Displace(x, y, x + side, y + 1);
+		return;
+	}
+	if (CanEnter(material, x - side, y + 1))
+	{
+		Displace(x, y, x - side, y + 1);
+		return;
+	}
 
-	//world = new unsigned char[screenWidth * screenHeight];
-	//memset(world, 0, screenWidth * screenHeight * sizeof(unsigned char));
+	// Level out through the run of this liquid the cell is part of. Under
+	// more of the liquid it fills any gap in the run, which is how gaps rise
+	// to the surface, and at the surface only a way further down will do.
+	bool pressed = y > 0 && materials[Index(x, y - 1)] == material;
+	int toX = FindOutlet(x, y, material, side, !pressed);
+	if (toX != x)
+		Displace(x, y, toX, y);
+}
 
-	world = new Object[screenWidth * screenHeight];
+// Where along row y the liquid at (x, y) should go to level out, or x if
+// nowhere. It goes through the run of the liquid it is in, to the nearest
+// cell it can enter, or with mustFall the nearest it can enter and then
+// fall from, which may be further along over open cells. An outlet beyond
+// maxReach is headed for as far as the cell can go this tick. Ties go to
+// the given side. A surface with no outlet in range is as level as whole
+// cells allow, so it rests and its chunk can go to sleep.
+int Simulation::FindOutlet(int x, int y, uint8_t material, int side, bool mustFall) const
+{
+	if (mustFall && y + 1 >= worldHeight)
+		return x;
 
-	for (int x = 0; x < screenWidth; ++x)
+	const uint8_t* row = materials.data() + Index(0, y);
+	const uint8_t* below = mustFall ? materials.data() + Index(0, y + 1) : nullptr;
+	int range = mustFall ? maxScan : maxReach;
+	// Each way, the furthest cell the liquid could move to now
+	int reachable[2] = { x, x };
+	bool blocked[2] = { false, false };
+	for (int distance = 1; distance <= range && !(blocked[0] && blocked[1]); ++distance)
 	{
-		for (int y = 0; y < screenHeight; ++y)
+		for (int i = 0; i < 2; ++i)
 		{
-			//world[y * screenWidth + x] = 0;
-			world[y * screenWidth + x] = { 0 };
+			int toX = x + (i == 0 ? side : -side) * distance;
+			if (blocked[i] || (toX >= 0 && toX < worldWidth && row[toX] == material))
+				continue;
+
+			if (toX < 0 || toX >= worldWidth || !registry.CanDisplace(material, row[toX]))
+			{
+				blocked[i] = true;
+				continue;
+			}
+			if (!mustFall)
+				return toX;
+
+			if (distance <= maxReach)
+				reachable[i] = toX;
+			if (registry.CanDisplace(material, below[toX]))
+			{
+				if (reachable[i] != x)
+					return reachable[i];
+				blocked[i] = true;
+			}
 		}
 	}
+	return x;
 }
 
+//*** Gas: rises, drifting sideways. It moves on every other tick, see
+// ProcessChunk, so through open air it rises two cells at a time.
+template<>
+void Simulation::UpdateCell<MovementClass::Gas>(int x, int y, uint8_t material, Random& rng)
+{
+	int side = rng.Range(-1, 1);
+	int toX = x;
+	int toY = y - 1;
+	if (CanEnter(material, x + side, y - 1))
+		toX = x + side;
+	else if (side == 0 || !CanEnter(material, x, y - 1))
+	{
+		if (side == 0 || !CanEnter(material, x + side, y))
+			return;
+		toX = x + side;
+		toY = y;
+	}
 
+	if (toY < y && toY > 0 && IsEmpty(toX, toY) && !occupancy.Test(toX, toY - 1))
+		--toY;
+	Displace(x, y, toX, toY);
+}
 
-
-void Simulation::ProcessSimulation()
+TickStats Simulation::ProcessChunk(Chunk& chunk, Random& rng)
 {
-	for (int x = screenWidth - 1; x > 0 ; --x)
+	TickStats stats;
+	uint8_t stamp = CurrentStamp();
+	std::vector<olc::vi2d>& rising = risingCells[(chunk.y / chunkSize) * chunksX + chunk.x / chunkSize];
+	rising.clear();
+
+	for (int y = chunk.maxY; y >= chunk.minY; --y)
 	{
-		for (int y = screenHeight - 1; y > 0; --y)
+		// Right to left over the occupied cells only. Each word is read
+		// once, so a cell moving into the part of the row still ahead is
+		// not visited, just as its stamp would have skipped it.
+		for (int word = chunk.maxX / OccupancyMap::wordBits; word >= chunk.minX / OccupancyMap::wordBits; --word)
 		{
+			int base = word * OccupancyMap::wordBits;
+			int lo = std::max(chunk.minX - base, 0);
+			int hi = std::min(chunk.maxX - base, OccupancyMap::wordBits - 1);
+			uint64_t bits = occupancy.GetWord(word, y) & OccupancyMap::Mask(lo, hi);
+
+			while (bits != 0)
+			{
+				int bit = OccupancyMap::HighestBit(bits);
+				bits &= ~(uint64_t(1) << bit);
+
+				int x = base + bit;
+				int index = Index(x, y);
+				uint8_t material = materials[index];
+				MovementClass movement = registry.GetMovement(material);
+				if (movement == MovementClass::Static || material == massMaterial)
+					continue;
+				if (movement == MovementClass::Gas)
+				{
+					rising.push_back({ x, y });
+					continue;
+				}
 
-			switch (world[y * screenWidth + x].id)
-			{ //*** Sand
-				case 1:
+				if (stamps[index] == stamp)
 				{
-					int velocity = 2;
-					do
-					{
-						int random = std::rand() % 2;
-						if (y + velocity < screenHeight && x + velocity < screenWidth && x - velocity > 0)
-						{
-							if (world[(y + velocity) * screenWidth + x].id == 0)
-							{
-								world[(y + velocity) * screenWidth + x] = { world[y * screenWidth + x].id, world[y * screenWidth + x].color };
-								world[y * screenWidth + x] = {};
-								break;
-							}
-							else if (world[(y + velocity) * screenWidth + (x + random)].id == 0)
-							{
-								world[(y + velocity) * screenWidth + (x + random)] = { world[y * screenWidth + x].id, world[y * screenWidth + x].color };
-								world[y * screenWidth + x] = {};
-							}
-							else if (world[(y + velocity) * screenWidth + (x - random)].id == 0)
-							{
-								world[(y + velocity) * screenWidth + (x - random)] = { world[y * screenWidth + x].id, world[y * screenWidth + x].color };
-								world[y * screenWidth + x] = {};
-								break;
-							}
-						}
-					} while (--velocity);
-					break;
+					++stats.revisitedCells;
+					continue;
 				}
-				case 2:
-				{ //*** Water
-					int velocity = 2;
-					do
-					{
-						int random = randomRange(-4, 3);
-						if (y + velocity < screenHeight && x + velocity < screenWidth && x - velocity > 0)
-						{
-							if (world[(y + velocity) * screenWidth + x].id == 0)
-							{
-								world[(y + velocity) * screenWidth + x] = { world[y * screenWidth + x].id, world[y * screenWidth + x].color };
-								world[y * screenWidth + x] = {};
-								break;
-							}
-							else if (world[(y + velocity) * screenWidth + (x + velocity)].id == 0)
-							{
-								world[(y + velocity) * screenWidth + (x + velocity)] = { world[y * screenWidth + x].id, world[y * screenWidth + x].color };
-								world[y * screenWidth + x] = {};
-								break;
-							}
-							else if (world[(y + velocity) * screenWidth + (x - velocity)].id == 0)
-							{
-								world[(y + velocity) * screenWidth + (x - velocity)] = { world[y * screenWidth + x].id, world[y * screenWidth + x].color };
-								world[y * screenWidth + x] = {};
-								break;
-							}
-							else if (world[y * screenWidth + (x + random)].id == 0)
-							{
-								world[y * screenWidth + (x + random)] = { world[y * screenWidth + x].id, world[y * screenWidth + x].color };
-								world[y * screenWidth + x] = {};
-								break;
-							}
-							else if (random != 0 && world[(y + random ) * screenWidth + (x + random)].id == 2)
-							{
-								Object swap = world[(y + random) * screenWidth + (x + random)];
-								world[(y + random) * screenWidth + (x + random)] = { world[y * screenWidth + x].id, world[y * screenWidth + x].color };
-								world[y * screenWidth + x] = swap;
-							}
-
-						}
-					} while (--velocity);
-					break;
+				++stats.processedCells;
+
+				switch (movement)
+				{
+					case MovementClass::Powder:
+						UpdateCell<MovementClass::Powder>(x, y, material, rng);
+						break;
+					case MovementClass::Liquid:
+						UpdateCell<MovementClass::Liquid>(x, y, material, rng);
+						break;
+					default:
+						break;
 				}
 			}
 		}
 	}
+
+	// Gas rises, so it goes top row first. Anything that moved since it was
+	// met is stamped, and a cell emptied or taken by something else is no
+	// longer gas.
+	//
+	// Gas is most of what moves in a cloud and moves all the time, so each
+	// column only moves on every other tick. On the tick between, the cells
+	// with somewhere to go keep their chunk awake with a single wake for all.
+	auto Open = [&](int x, int y) { return InBounds(x, y) && !occupancy.Test(x, y); };
+	int waitMinX = INT_MAX, waitMinY = INT_MAX;
+	int waitMaxX = INT_MIN, waitMaxY = INT_MIN;
+	for (auto cell = rising.rbegin(); cell != rising.rend(); ++cell)
+	{
+		int x = cell->x;
+		int y = cell->y;
+		int index = Index(x, y);
+		uint8_t material = materials[index];
+		if (registry.GetMovement(material) != MovementClass::Gas)
+			continue;
+
+		if (((x + tick) & 1) != 0)
+		{
+			if (Open(x - 1, y - 1) || Open(x, y - 1) || Open(x + 1, y - 1) || Open(x - 1, y) || Open(x + 1, y))
+			{
+				waitMinX = std::min(waitMinX, x);
+				waitMinY = std::min(waitMinY, y);
+				waitMaxX = std::max(waitMaxX, x);
+				waitMaxY = std::max(waitMaxY, y);
+			}
+			continue;
+		}
+
+		if (stamps[index] == stamp)
+		{
+			++stats.revisitedCells;
+			continue;
+		}
+		++stats.processedCells;
+		UpdateCell<MovementClass::Gas>(x, y, material, rng);
+	}
+	if (waitMinX <= waitMaxX)
+		WakeRect(waitMinX, waitMinY, waitMaxX, waitMaxY);
+
+	return stats;
+}
+
+// Lets cells with a lifetime vanish, in the chunks whose turn it is
+void Simulation::FadeCells(uint64_t tickSeed)
+{
+	fadeChunks.clear();
+	for (size_t index = size_t(tick % fadePeriod); index < chunks.size(); index += fadePeriod)
+		if (fadingChunks[index])
+			fadeChunks.push_back(int(index));
+
+	threadPool.ParallelFor(int(fadeChunks.size()), [&](int i)
+	{
+		int index = fadeChunks[i];
+		const Chunk& chunk = chunks[index];
+		olc::TraceScope traceChunk("Fade", index);
+		// Streams after the heat's
+		Random rng(tickSeed, uint64_t(3 * chunks.size() + index));
+		bool fading = false;
+		for (int y = chunk.y; y < chunk.y + chunk.height; ++y)
+		{
+			for (int word = chunk.x / OccupancyMap::wordBits; word <= (chunk.x + chunk.width - 1) / OccupancyMap::wordBits; ++word)
+			{
+				uint64_t bits = occupancy.GetWord(word, y);
+				while (bits != 0)
+				{
+					int bit = OccupancyMap::HighestBit(bits);
+					bits &= ~(uint64_t(1) << bit);
+
+					int x = word * OccupancyMap::wordBits + bit;
+					int lifetime = registry.GetLifetime(materials[Index(x, y)]);
+					if (lifetime == 0)
+						continue;
+					if (rng.Below(lifetime) < fadePeriod)
+						SetCell(x, y, MaterialId::Empty, olc::BLACK);
+					else
+						fading = true;
+				}
+			}
+		}
+		fadingChunks[index] = fading;
+	});
 }
@@ -0,0 +1,142 @@
+#include "simulationthread.h"
+#include <chrono>
+
+SimulationThread::~SimulationThread()
+{
+	Stop();
+}
+
+void SimulationThread::Start(double ticksPerSecond)
+{
+	if (running)
+		return;
+
+	running = true;
+	thread = std::thread(&SimulationThread::Run, this, ticksPerSecond);
+}
+
+void SimulationThread::Stop()
+{
+	running = false;
+	if (thread.joinable())
+		thread.join();
+}
+
+void SimulationThread::Step()
+{
+	if (!running)
+		Tick();
+}
+
+void SimulationThread::Invalidate()
+{
+	if (!running)
+		redrawView = true;
+}
+
+void SimulationThread::Push(const SimulationCommand& command)
+{
+	std::lock_guard<std::mutex> lock(inputMutex);
+	queuedInput.push_back(command);
+}
+
+void SimulationThread::SetCamera(const Camera& newCamera)
+{
+	std::lock_guard<std::mutex> lock(inputMutex);
+	queuedCamera = newCamera;
+}
+
+void SimulationThread::SetProfiler(olc::Profiler* newProfiler)
+{
+	profiler = newProfiler;
+	if (profiler)
+	{
+		phaseInput = profiler->AddPhase("Sim input");
+		phaseTick = profiler->AddPhase("Sim tick");
+		phasePublish = profiler->AddPhase("Sim publish");
+	}
+}
+
+void SimulationThread::Run(double ticksPerSecond)
+{
+	using Clock = std::chrono::steady_clock;
+	Clock::duration interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / ticksPerSecond));
+	Clock::time_point next = Clock::now();
+	olc::Trace::SetThreadName("Simulation");
+
+	while (running)
+	{
+		Tick();
+
+		// Ticks are scheduled from the start time, not from when the last
+		// one ended, so the rate does not drift. A late tick is followed
+		// straight away by the next one until the schedule is caught up.
+		next += interval;
+		Clock::time_point now = Clock::now();
+		if (now - next > interval * int(maxLagTicks))
+			next = now;
+		else if (next > now)
+			std::this_thread::sleep_until(next);
+	}
+}
+
+void SimulationThread::Tick()
+{
+	using Clock = olc::Profiler::Clock;
+	Clock::time_point start = Clock::now();
+	Camera nextCamera;
+	{
+		olc::TraceScope traceInput("Input");
+		{
+			std::lock_guard<std::mutex> lock(inputMutex);
+			std::swap(queuedInput, tickInput);
+			nextCamera = queuedCamera;
+		}
+		// Sliding the window first means brushes near the view always land
+		simulation.Follow(nextCamera.x, nextCamera.y, nextCamera.x + nextCamera.GetCellsX() - 1, nextCamera.y + nextCamera.GetCellsY() - 1);
+		for (const SimulationCommand& command : tickInput)
+			simulation.Apply(command);
+		tickInput.clear();
+	}
+
+	Clock::time_point inputDone = Clock::now();
+	simulation.ProcessSimulation();
+
+	Clock::time_point tickDone = Clock::now();
+	{
+		olc::TraceScope tracePublish("Publish");
+		nextCamera.x -= simulation.GetOrigin().x;
+		nextCamera.y -= simulation.GetOrigin().y;
+		if (!frames.Matches(nextCamera.width, nextCamera.height))
+		{
+			frames.Reset(nextCamera.width, nextCamera.height);
+			view.assign(size_t(nextCamera.width) * nextCamera.height, olc::BLACK);
+			redrawView = true;
+		}
+
+		viewChanged.Clear();
+		if (redrawView || nextCamera != camera)
+		{
+			camera = nextCamera;
+			viewChanged.Add(0, 0, camera.width, camera.height);
+			redrawView = false;
+		}
+		else
+		{
+			changed.Clear();
+			simulation.CollectDirtyRegion(changed);
+			camera.AddToView(changed, viewChanged);
+		}
+
+		simulation.DrawView(camera, view.data(), viewChanged);
+		frames.Publish(view.data(), viewChanged, simulation.GetTick());
+	}
+
+	if (profiler)
+	{
+		auto Milliseconds = [](Clock::duration d) { return std::chrono::duration<float, std::milli>(d).count(); };
+		profiler->Record(phaseInput, Milliseconds(inputDone - start));
+		profiler->Record(phaseTick, Milliseconds(tickDone - inputDone));
+		profiler->Record(phasePublish, tickDone);
+	}
+}
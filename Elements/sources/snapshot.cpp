@@ -0,0 +1,384 @@
+#include "simulation.h"
+#include "mappedfile.h"
+#include "runlength.h"
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+// Snapshot layout, little-endian:
+//
+//   SnapshotHeader
+//   sections, each starting on a 64 byte boundary
+//
+// The header lists every section's offset and size, so a reader skips
+// straight to what it needs. Chunk rectangles and emitters are always
+// stored raw. The cell planes are raw too unless the file is compressed,
+// in which case each one is a stream of runs (see runlength.h).
+
+namespace
+{
+	constexpr char snapshotMagic[8] = { 'E', 'L', 'E', 'M', 'S', 'N', 'A', 'P' };
+	// Version 1 had no velocities section, its cells load at rest. Version
+	// 2 had no flying particles, and version 3 no masses, so its water is
+	// in whole cells. Version 4 had no temperatures, it loads at the ambient
+	// temperature. Version 5 had no masses of flying particles, their water
+	// is in whole cells.
+	constexpr uint32_t snapshotVersion = 6;
+	constexpr uint32_t flagCompressed = 1;
+	constexpr uint32_t flagMassWater = 2;
+	constexpr size_t sectionAlignment = 64;
+
+	// Guards the allocation against a damaged header
+	constexpr int32_t maxSide = 1 << 16;
+	// Far beyond any brush, and small enough to square in Spray
+	constexpr int32_t maxEmitterRadius = 1 << 12;
+
+	enum Section
+	{
+		SectionMaterials,
+		SectionColors,
+		SectionStamps,
+		SectionChunks,
+		SectionEmitters,
+		SectionVelocities,
+		SectionFlying,
+		SectionMasses,
+		SectionTemperatures,
+		SectionFlyingMasses,
+		SectionCount
+	};
+
+	// Sections in the header of each version, counted from 1
+	constexpr size_t versionSections[] = { 0, SectionVelocities, SectionFlying, SectionMasses, SectionTemperatures, SectionFlyingMasses, SectionCount };
+
+	struct SnapshotHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t flags;
+		int32_t width;
+		int32_t height;
+		int32_t chunksX;
+		int32_t chunksY;
+		uint32_t materialCount;
+		uint32_t emitterCount;
+		uint64_t seed;
+		uint64_t tick;
+		uint64_t randomState;
+		uint64_t randomIncrement;
+		struct
+		{
+			uint64_t offset;
+			uint64_t size;
+		} sections[SectionCount];
+	};
+
+	// Per chunk: the current rectangle, then the one gathered for the next tick
+	constexpr size_t chunkInts = 8;
+	// Per emitter: x, y, radius, material, rate
+	constexpr size_t emitterInts = 5;
+	// Per flying particle: x, y, vx and vy, then material and color
+	constexpr size_t flyingBytes = 4 * sizeof(float) + sizeof(uint8_t) + sizeof(olc::Pixel);
+
+	template<typename T>
+	void WritePlane(const std::vector<T>& plane, bool compress, std::vector<uint8_t>& out)
+	{
+		if (compress)
+			EncodeRuns(plane.data(), plane.size(), out);
+		else
+			Append(out, plane.data(), plane.size());
+	}
+
+	// A raw plane is copied with no parsing at all
+	template<typename T>
+	bool ReadPlane(const uint8_t* in, size_t size, bool compressed, std::vector<T>& plane)
+	{
+		if (compressed)
+			return DecodeRuns(in, size, plane.data(), plane.size());
+
+		if (size != plane.size() * sizeof(T))
+			return false;
+		memcpy(plane.data(), in, size);
+		return true;
+	}
+}
+
+bool Simulation::SaveSnapshot(const std::string& path, bool compress) const
+{
+	SnapshotHeader header = {};
+	memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+	header.version = snapshotVersion;
+	header.flags = (compress ? flagCompressed : 0) | (waterModel == WaterModel::Mass ? flagMassWater : 0);
+	header.width = worldWidth;
+	header.height = worldHeight;
+	header.chunksX = chunksX;
+	header.chunksY = chunksY;
+	header.materialCount = uint32_t(registry.GetCount());
+	header.emitterCount = uint32_t(emitters.size());
+	header.seed = worldSeed;
+	header.tick = tick;
+	header.randomState = mainRandom.GetState();
+	header.randomIncrement = mainRandom.GetIncrement();
+
+	std::vector<uint8_t> file(sizeof(SnapshotHeader));
+	auto BeginSection = [&](Section section)
+	{
+		file.resize((file.size() + sectionAlignment - 1) / sectionAlignment * sectionAlignment);
+		header.sections[section].offset = file.size();
+	};
+	auto EndSection = [&](Section section)
+	{
+		header.sections[section].size = file.size() - header.sections[section].offset;
+	};
+
+	BeginSection(SectionMaterials);
+	WritePlane(materials, compress, file);
+	EndSection(SectionMaterials);
+
+	BeginSection(SectionColors);
+	WritePlane(colors, compress, file);
+	EndSection(SectionColors);
+
+	BeginSection(SectionStamps);
+	WritePlane(stamps, compress, file);
+	EndSection(SectionStamps);
+
+	BeginSection(SectionChunks);
+	for (const Chunk& chunk : chunks)
+	{
+		int32_t rects[chunkInts] =
+		{
+			chunk.minX, chunk.minY, chunk.maxX, chunk.maxY,
+			chunk.nextMinX.load(), chunk.nextMinY.load(), chunk.nextMaxX.load(), chunk.nextMaxY.load()
+		};
+		Append(file, rects, chunkInts);
+	}
+	EndSection(SectionChunks);
+
+	BeginSection(SectionEmitters);
+	for (const Emitter& emitter : emitters)
+	{
+		int32_t values[emitterInts] = { emitter.x, emitter.y, emitter.radius, emitter.material, emitter.rate };
+		Append(file, values, emitterInts);
+	}
+	EndSection(SectionEmitters);
+
+	BeginSection(SectionVelocities);
+	WritePlane(velocities, compress, file);
+	EndSection(SectionVelocities);
+
+	// Each field whole, one after the other
+	BeginSection(SectionFlying);
+	Append(file, flying.x.data(), flying.Size());
+	Append(file, flying.y.data(), flying.Size());
+	Append(file, flying.vx.data(), flying.Size());
+	Append(file, flying.vy.data(), flying.Size());
+	Append(file, flying.material.data(), flying.Size());
+	Append(file, flying.color.data(), flying.Size());
+	EndSection(SectionFlying);
+
+	BeginSection(SectionMasses);
+	WritePlane(masses, compress, file);
+	EndSection(SectionMasses);
+
+	BeginSection(SectionTemperatures);
+	WritePlane(temperatures, compress, file);
+	EndSection(SectionTemperatures);
+
+	BeginSection(SectionFlyingMasses);
+	Append(file, flying.mass.data(), flying.Size());
+	EndSection(SectionFlyingMasses);
+
+	memcpy(file.data(), &header, sizeof(header));
+
+	// Closing flushes, which is where a full disk shows up
+	std::ofstream out(path, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(file.data()), std::streamsize(file.size()));
+	out.close();
+	return !out.fail();
+}
+
+bool Simulation::LoadSnapshot(const std::string& path)
+{
+	MappedFile file;
+	if (!file.Open(path) || file.GetSize() < offsetof(SnapshotHeader, sections))
+		return false;
+
+	// Sections are only ever added at the end, so an older header is a
+	// prefix of the current one
+	SnapshotHeader header = {};
+	memcpy(&header, file.GetData(), offsetof(SnapshotHeader, sections));
+	if (memcmp(header.magic, snapshotMagic, sizeof(snapshotMagic)) != 0 || header.version < 1 || header.version > snapshotVersion)
+		return false;
+	size_t sectionCount = versionSections[header.version];
+	size_t headerSize = offsetof(SnapshotHeader, sections) + sectionCount * sizeof(header.sections[0]);
+	if (file.GetSize() < headerSize)
+		return false;
+	memcpy(&header, file.GetData(), headerSize);
+	if (header.width <= 0 || header.height <= 0 || header.width > maxSide || header.height > maxSide ||
+		header.materialCount > uint32_t(registry.GetCount()))
+		return false;
+	if (header.chunksX != (header.width + chunkSize - 1) / chunkSize || header.chunksY != (header.height + chunkSize - 1) / chunkSize)
+		return false;
+
+	for (const auto& section : header.sections)
+		if (section.offset > file.GetSize() || section.size > file.GetSize() - section.offset)
+			return false;
+
+	size_t chunkCount = size_t(header.chunksX) * header.chunksY;
+	if (header.sections[SectionChunks].size != chunkCount * chunkInts * sizeof(int32_t) ||
+		header.sections[SectionEmitters].size != header.emitterCount * emitterInts * sizeof(int32_t) ||
+		header.sections[SectionFlying].size % flyingBytes != 0)
+		return false;
+
+	// Planes are read into fresh storage, so a damaged file leaves the
+	// current world alone
+	size_t cellCount = size_t(header.width) * header.height;
+	std::vector<uint8_t> newMaterials(cellCount);
+	std::vector<olc::Pixel> newColors(cellCount);
+	std::vector<uint8_t> newStamps(cellCount);
+	std::vector<uint8_t> newVelocities(cellCount);
+	std::vector<float> newMasses(cellCount);
+	size_t blockCount = size_t((header.width + heatBlock - 1) / heatBlock) * ((header.height + heatBlock - 1) / heatBlock);
+	std::vector<float> newTemperatures(blockCount, ambientTemperature);
+
+	bool compressed = (header.flags & flagCompressed) != 0;
+	auto SectionData = [&](Section section) { return file.GetData() + header.sections[section].offset; };
+	auto SectionSize = [&](Section section) { return size_t(header.sections[section].size); };
+
+	if (!ReadPlane(SectionData(SectionMaterials), SectionSize(SectionMaterials), compressed, newMaterials) ||
+		!ReadPlane(SectionData(SectionColors), SectionSize(SectionColors), compressed, newColors) ||
+		!ReadPlane(SectionData(SectionStamps), SectionSize(SectionStamps), compressed, newStamps))
+		return false;
+	if (header.version > 1 && !ReadPlane(SectionData(SectionVelocities), SectionSize(SectionVelocities), compressed, newVelocities))
+		return false;
+	if (header.version > 3 && !ReadPlane(SectionData(SectionMasses), SectionSize(SectionMasses), compressed, newMasses))
+		return false;
+	if (header.version > 4 && !ReadPlane(SectionData(SectionTemperatures), SectionSize(SectionTemperatures), compressed, newTemperatures))
+		return false;
+	if (header.version <= 3)
+		for (size_t i = 0; i < cellCount; ++i)
+			newMasses[i] = newMaterials[i] == MaterialId::Water ? 1.0f : 0.0f;
+
+	// Every id indexes the registry's tables on the next tick
+	for (uint8_t material : newMaterials)
+		if (material >= registry.GetCount())
+			return false;
+
+	// A rectangle is either empty or inside its chunk, anything else would
+	// send the update loop outside the world
+	const uint8_t* chunkData = SectionData(SectionChunks);
+	for (size_t i = 0; i < chunkCount * 2; ++i)
+	{
+		int32_t rect[4];
+		memcpy(rect, chunkData + i * sizeof(rect), sizeof(rect));
+		int chunkX = int(i / 2 % header.chunksX) * chunkSize;
+		int chunkY = int(i / 2 / header.chunksX) * chunkSize;
+		bool empty = rect[0] > rect[2] || rect[1] > rect[3];
+		if (!empty && (rect[0] < chunkX || rect[1] < chunkY || rect[2] >= std::min(chunkX + chunkSize, header.width) ||
+			rect[3] >= std::min(chunkY + chunkSize, header.height)))
+			return false;
+	}
+
+	size_t flyingCount = SectionSize(SectionFlying) / flyingBytes;
+	const uint8_t* flyingData = SectionData(SectionFlying);
+	FlyingParticles newFlying;
+	auto ReadField = [&](auto& field)
+	{
+		field.resize(flyingCount);
+		if (flyingCount == 0)
+			return;
+		memcpy(field.data(), flyingData, flyingCount * sizeof(field[0]));
+		flyingData += flyingCount * sizeof(field[0]);
+	};
+	ReadField(newFlying.x);
+	ReadField(newFlying.y);
+	ReadField(newFlying.vx);
+	ReadField(newFlying.vy);
+	ReadField(newFlying.material);
+	ReadField(newFlying.color);
+	if (header.version > 5)
+	{
+		if (SectionSize(SectionFlyingMasses) != flyingCount * sizeof(float))
+			return false;
+		flyingData = SectionData(SectionFlyingMasses);
+		ReadField(newFlying.mass);
+	}
+	else
+	{
+		newFlying.mass.resize(flyingCount);
+		for (size_t i = 0; i < flyingCount; ++i)
+			newFlying.mass[i] = newFlying.material[i] == MaterialId::Water ? 1.0f : 0.0f;
+	}
+
+	// A particle in the air is over a column of the world, below its bottom
+	// edge and no higher above its top than it could be thrown, at no more
+	// than the greatest speed. Anything else would send a landing outside it.
+	float limit = maxFlightSpeed;
+	float ceiling = -limit * limit / (2.0f * flightGravity) - limit;
+	for (size_t i = 0; i < flyingCount; ++i)
+	{
+		float x = newFlying.x[i];
+		float y = newFlying.y[i];
+		float vx = newFlying.vx[i];
+		float vy = newFlying.vy[i];
+		if (!(x >= 0.0f && x < float(header.width) && y >= ceiling && y < float(header.height) &&
+			std::abs(vx) <= limit && std::abs(vy) <= limit && newFlying.mass[i] >= 0.0f && std::isfinite(newFlying.mass[i])) ||
+			newFlying.material[i] >= registry.GetCount())
+			return false;
+	}
+
+	std::vector<Emitter> newEmitters;
+	const uint8_t* emitterData = SectionData(SectionEmitters);
+	for (uint32_t i = 0; i < header.emitterCount; ++i)
+	{
+		int32_t values[emitterInts];
+		memcpy(values, emitterData, sizeof(values));
+		emitterData += sizeof(values);
+		if (values[2] < 0 || values[2] > maxEmitterRadius || values[3] < 0 || values[3] >= registry.GetCount() || values[4] <= 0)
+			return false;
+		newEmitters.push_back({ values[0], values[1], values[2], uint8_t(values[3]), values[4] });
+	}
+
+	if (header.width != worldWidth || header.height != worldHeight || chunks.empty())
+		InitSimulation(header.width, header.height);
+
+	materials.swap(newMaterials);
+	colors.swap(newColors);
+	stamps.swap(newStamps);
+	velocities.swap(newVelocities);
+	masses.swap(newMasses);
+	temperatures.swap(newTemperatures);
+	occupancy.Build(materials, worldWidth);
+	for (int by = 0; by < heatHeight; ++by)
+		for (int bx = 0; bx < heatWidth; ++bx)
+			MeasureBlock(bx, by);
+
+	for (Chunk& chunk : chunks)
+	{
+		int32_t rects[chunkInts];
+		memcpy(rects, chunkData, sizeof(rects));
+		chunkData += sizeof(rects);
+
+		chunk.minX = rects[0]; chunk.minY = rects[1];
+		chunk.maxX = rects[2]; chunk.maxY = rects[3];
+		chunk.nextMinX = rects[4]; chunk.nextMinY = rects[5];
+		chunk.nextMaxX = rects[6]; chunk.nextMaxY = rects[7];
+	}
+
+	emitters.swap(newEmitters);
+	flying = std::move(newFlying);
+	for (FlyingParticles& list : launches)
+		list.Clear();
+	// Which chunks hold cells with a lifetime is not saved, so every chunk
+	// fades on its next turn
+	fadingChunks.assign(chunks.size(), 1);
+
+	waterModel = (header.flags & flagMassWater) != 0 ? WaterModel::Mass : WaterModel::Cells;
+	massMaterial = waterModel == WaterModel::Mass ? uint8_t(MaterialId::Water) : uint8_t(MaterialId::Empty);
+	worldSeed = header.seed;
+	tick = header.tick;
+	mainRandom.Restore(header.randomState, header.randomIncrement);
+	return true;
+}
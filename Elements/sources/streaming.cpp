@@ -0,0 +1,259 @@
+#include "simulation.h"
+#include <cstring>
+
+// The unbounded world. The planes hold a window of it, chunksX by chunksY
+// chunks with its top left at origin, and everything else is in the chunk
+// store. The window slides by whole chunks, so a chunk is always resident
+// or stored as a whole, and its cells keep their offsets inside it.
+
+namespace
+{
+	int FloorDiv(int a, int b)
+	{
+		return a >= 0 ? a / b : -((-a + b - 1) / b);
+	}
+
+	// Moves a plane by (-dx, -dy) cells, filling what is uncovered
+	template<typename T>
+	void ShiftPlane(std::vector<T>& plane, int width, int height, int dx, int dy, T fill)
+	{
+		// Walk rows in the direction that never overwrites a source row
+		// before it is read
+		for (int i = 0; i < height; ++i)
+		{
+			int y = dy >= 0 ? i : height - 1 - i;
+			T* row = plane.data() + size_t(y) * width;
+			int from = y + dy;
+			int x0 = std::max(-dx, 0);
+			int x1 = std::min(width - dx, width);
+			if (from < 0 || from >= height || x0 >= x1)
+			{
+				std::fill(row, row + width, fill);
+				continue;
+			}
+
+			memmove(row + x0, plane.data() + size_t(from) * width + x0 + dx, size_t(x1 - x0) * sizeof(T));
+			std::fill(row, row + x0, fill);
+			std::fill(row + x1, row + width, fill);
+		}
+	}
+}
+
+void Simulation::SetChunkStore(ChunkStore* store)
+{
+	chunkStore = store;
+	if (!chunkStore)
+		return;
+
+	int width = chunksX * chunkSize;
+	int height = chunksY * chunkSize;
+	if (width != worldWidth || height != worldHeight)
+		InitSimulation(width, height);
+
+	for (int cy = 0; cy < chunksY; ++cy)
+		for (int cx = 0; cx < chunksX; ++cx)
+			LoadChunk(cx, cy);
+	PrefetchAround();
+}
+
+void Simulation::Follow(int x0, int y0, int x1, int y1)
+{
+	if (!chunkStore)
+		return;
+
+	// The followed area and the window in cells relative to the window
+	int margin = streamMargin * chunkSize;
+	x0 -= origin.x; x1 -= origin.x;
+	y0 -= origin.y; y1 -= origin.y;
+
+	// Slide just far enough to restore the margin on the side that lost
+	// it. An area too big to fit with its margins is centred instead.
+	auto Slide = [&](int lo, int hi, int size)
+	{
+		if (hi - lo + 1 > size - 2 * margin)
+			return FloorDiv((lo + hi) / 2 - size / 2, chunkSize);
+		if (lo < margin)
+			return FloorDiv(lo - margin, chunkSize);
+		if (hi >= size - margin)
+			return (hi - (size - margin) + chunkSize) / chunkSize;
+		return 0;
+	};
+
+	int right = Slide(x0, x1, worldWidth);
+	int down = Slide(y0, y1, worldHeight);
+	if (right != 0 || down != 0)
+		ShiftWindow(right, down);
+}
+
+void Simulation::StoreResident()
+{
+	if (!chunkStore)
+		return;
+
+	for (int cy = 0; cy < chunksY; ++cy)
+		for (int cx = 0; cx < chunksX; ++cx)
+			EvictChunk(cx, cy);
+}
+
+void Simulation::ShiftWindow(int chunksRight, int chunksDown)
+{
+	olc::TraceScope traceShift("Shift window");
+
+	auto Outside = [&](int cx, int cy) { return cx < 0 || cx >= chunksX || cy < 0 || cy >= chunksY; };
+
+	// Chunks whose new place is outside the window leave it
+	for (int cy = 0; cy < chunksY; ++cy)
+		for (int cx = 0; cx < chunksX; ++cx)
+			if (Outside(cx - chunksRight, cy - chunksDown))
+				EvictChunk(cx, cy);
+
+	int dx = chunksRight * chunkSize;
+	int dy = chunksDown * chunkSize;
+	ShiftPlane(materials, worldWidth, worldHeight, dx, dy, uint8_t(MaterialId::Empty));
+	ShiftPlane(colors, worldWidth, worldHeight, dx, dy, olc::BLACK);
+	ShiftPlane(stamps, worldWidth, worldHeight, dx, dy, uint8_t(0));
+	ShiftPlane(velocities, worldWidth, worldHeight, dx, dy, uint8_t(0));
+	ShiftPlane(masses, worldWidth, worldHeight, dx, dy, 0.0f);
+	ShiftPlane(temperatures, heatWidth, heatHeight, dx / heatBlock, dy / heatBlock, ambientTemperature);
+	ShiftPlane(conductivities, heatWidth, heatHeight, dx / heatBlock, dy / heatBlock, registry.GetConductivity(MaterialId::Empty));
+	ShiftPlane(glows, heatWidth, heatHeight, dx / heatBlock, dy / heatBlock, 0.0f);
+	ShiftPlane(glowHeats, heatWidth, heatHeight, dx / heatBlock, dy / heatBlock, 0.0f);
+	ShiftPlane(hotLimits, heatWidth, heatHeight, dx / heatBlock, dy / heatBlock, FLT_MAX);
+	ShiftPlane(coldLimits, heatWidth, heatHeight, dx / heatBlock, dy / heatBlock, -FLT_MAX);
+	occupancy.Build(materials, worldWidth);
+	// Rather than move with their chunks, the fading flags are all raised
+	// and each chunk looks for cells with a lifetime on its next turn
+	std::fill(fadingChunks.begin(), fadingChunks.end(), 1);
+
+	// Rectangles travel with their chunks. Chunk objects hold atomics, so
+	// the rectangles are copied out rather than the chunks moved.
+	struct Rects { int minX, minY, maxX, maxY, nextMinX, nextMinY, nextMaxX, nextMaxY; };
+	std::vector<Rects> rects(chunks.size());
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		const Chunk& c = chunks[i];
+		rects[i] = { c.minX, c.minY, c.maxX, c.maxY, c.nextMinX.load(), c.nextMinY.load(), c.nextMaxX.load(), c.nextMaxY.load() };
+	}
+
+	auto Move = [](int value, int offset, bool empty) { return empty ? value : value - offset; };
+	for (int cy = 0; cy < chunksY; ++cy)
+	{
+		for (int cx = 0; cx < chunksX; ++cx)
+		{
+			Chunk& chunk = chunks[cy * chunksX + cx];
+			int fromX = cx + chunksRight;
+			int fromY = cy + chunksDown;
+			if (Outside(fromX, fromY))
+			{
+				chunk.minX = chunk.minY = INT_MAX;
+				chunk.maxX = chunk.maxY = INT_MIN;
+				chunk.nextMinX = chunk.nextMinY = INT_MAX;
+				chunk.nextMaxX = chunk.nextMaxY = INT_MIN;
+				continue;
+			}
+
+			const Rects& r = rects[fromY * chunksX + fromX];
+			bool empty = r.minX > r.maxX;
+			bool nextEmpty = r.nextMinX > r.nextMaxX;
+			chunk.minX = Move(r.minX, dx, empty); chunk.maxX = Move(r.maxX, dx, empty);
+			chunk.minY = Move(r.minY, dy, empty); chunk.maxY = Move(r.maxY, dy, empty);
+			chunk.nextMinX = Move(r.nextMinX, dx, nextEmpty); chunk.nextMaxX = Move(r.nextMaxX, dx, nextEmpty);
+			chunk.nextMinY = Move(r.nextMinY, dy, nextEmpty); chunk.nextMaxY = Move(r.nextMaxY, dy, nextEmpty);
+		}
+	}
+
+	origin.x += dx;
+	origin.y += dy;
+	for (Emitter& emitter : emitters)
+	{
+		emitter.x -= dx;
+		emitter.y -= dy;
+	}
+	for (size_t i = 0; i < flying.Size(); ++i)
+	{
+		flying.x[i] -= float(dx);
+		flying.y[i] -= float(dy);
+	}
+
+	// and chunks whose old place was outside it enter
+	for (int cy = 0; cy < chunksY; ++cy)
+		for (int cx = 0; cx < chunksX; ++cx)
+			if (Outside(cx + chunksRight, cy + chunksDown))
+				LoadChunk(cx, cy);
+	PrefetchAround();
+}
+
+void Simulation::EvictChunk(int cx, int cy)
+{
+	const Chunk& chunk = chunks[cy * chunksX + cx];
+	bool occupied = false;
+	for (int y = chunk.y; y < chunk.y + chunkSize && !occupied; ++y)
+		for (int x = chunk.x; x < chunk.x + chunkSize && !occupied; x += OccupancyMap::wordBits)
+			occupied = occupancy.GetWord(x / OccupancyMap::wordBits, y) != 0;
+
+	// An empty chunk is saved as nothing, which also clears an old file
+	ChunkCells cells;
+	if (occupied)
+	{
+		cells.materials.reserve(size_t(chunkSize) * chunkSize);
+		cells.colors.reserve(size_t(chunkSize) * chunkSize);
+		for (int y = chunk.y; y < chunk.y + chunkSize; ++y)
+		{
+			int index = Index(chunk.x, y);
+			cells.materials.insert(cells.materials.end(), materials.begin() + index, materials.begin() + index + chunkSize);
+			cells.colors.insert(cells.colors.end(), colors.begin() + index, colors.begin() + index + chunkSize);
+		}
+	}
+
+	olc::vi2d coord = { FloorDiv(origin.x, chunkSize) + cx, FloorDiv(origin.y, chunkSize) + cy };
+	chunkStore->Save(coord, std::move(cells));
+}
+
+void Simulation::LoadChunk(int cx, int cy)
+{
+	olc::vi2d coord = { FloorDiv(origin.x, chunkSize) + cx, FloorDiv(origin.y, chunkSize) + cy };
+	ChunkCells cells = chunkStore->Load(coord);
+	if (cells.Empty())
+		return;
+
+	const Chunk& chunk = chunks[cy * chunksX + cx];
+	int materialCount = registry.GetCount();
+	for (int y = 0; y < chunkSize; ++y)
+	{
+		int index = Index(chunk.x, chunk.y + y);
+		for (int x = 0; x < chunkSize; ++x)
+		{
+			// Materials registered by another build are dropped
+			uint8_t material = cells.materials[y * chunkSize + x];
+			bool known = material < materialCount;
+			bool occupied = known && material != MaterialId::Empty;
+			materials[index + x] = occupied ? material : uint8_t(MaterialId::Empty);
+			colors[index + x] = occupied ? cells.colors[y * chunkSize + x] : olc::BLACK;
+			stamps[index + x] = uint8_t(tick - 1);
+			velocities[index + x] = 0;
+			masses[index + x] = material == MaterialId::Water && occupied ? 1.0f : 0.0f;
+			occupancy.Assign(chunk.x + x, chunk.y + y, occupied);
+		}
+	}
+
+	for (int by = chunk.y / heatBlock; by < (chunk.y + chunkSize) / heatBlock; ++by)
+		for (int bx = chunk.x / heatBlock; bx < (chunk.x + chunkSize) / heatBlock; ++bx)
+			MeasureBlock(bx, by);
+
+	// It was frozen mid-fall perhaps, so it gets a look on the next tick.
+	// Velocities, masses and temperatures are not stored, it starts again
+	// from rest with its water in whole cells, at the ambient temperature.
+	WakeRect(chunk.x, chunk.y, chunk.x + chunkSize - 1, chunk.y + chunkSize - 1);
+}
+
+void Simulation::PrefetchAround()
+{
+	int originX = FloorDiv(origin.x, chunkSize);
+	int originY = FloorDiv(origin.y, chunkSize);
+	std::vector<olc::vi2d> ring;
+	for (int cy = -streamMargin; cy < chunksY + streamMargin; ++cy)
+		for (int cx = -streamMargin; cx < chunksX + streamMargin; ++cx)
+			if (cx < 0 || cx >= chunksX || cy < 0 || cy >= chunksY)
+				ring.push_back({ originX + cx, originY + cy });
+	chunkStore->Prefetch(ring);
+}
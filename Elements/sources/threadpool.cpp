@@ -0,0 +1,87 @@
+#include "threadpool.h"
+#include "PixelGameEngine.h"
+
+ThreadPool::~ThreadPool()
+{
+	StopWorkers();
+}
+
+void ThreadPool::SetThreadCount(int count)
+{
+	StopWorkers();
+
+	for (int i = 1; i < count; ++i)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+void ThreadPool::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	workers.clear();
+	stopping = false;
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& job)
+{
+	if (workers.empty() || count <= 1)
+	{
+		for (int i = 0; i < count; ++i)
+			job(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->job = &job;
+		jobCount = count;
+		nextIndex = 0;
+		++generation;
+	}
+	wake.notify_all();
+
+	RunJob();
+
+	// Workers still inside RunJob would otherwise pick up indices
+	// of the next job with this job's function
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return busyWorkers == 0; });
+	this->job = nullptr;
+}
+
+void ThreadPool::RunJob()
+{
+	for (int i = nextIndex++; i < jobCount; i = nextIndex++)
+		(*job)(i);
+}
+
+void ThreadPool::WorkerLoop()
+{
+	olc::Trace::SetThreadName("Worker");
+	uint64_t seen = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		wake.wait(lock, [&] { return stopping || (generation != seen && job != nullptr); });
+		if (stopping)
+			return;
+
+		seen = generation;
+		++busyWorkers;
+		lock.unlock();
+
+		RunJob();
+
+		lock.lock();
+		if (--busyWorkers == 0)
+			finished.notify_all();
+	}
+}
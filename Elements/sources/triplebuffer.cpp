@@ -0,0 +1,69 @@
+#include "triplebuffer.h"
+#include <algorithm>
+
+void TripleBuffer::Reset(int width, int height)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	frameWidth = width;
+	frameHeight = height;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		frames[i].pixels.assign(size_t(width) * height, olc::BLACK);
+		frames[i].changed.Clear();
+		frames[i].tick = 0;
+		stale[i].Clear();
+		stale[i].Add(0, 0, width, height);
+	}
+
+	// The reader has never seen any of it
+	pending.Clear();
+	pending.Add(0, 0, width, height);
+
+	writeSlot = 0;
+	readySlot = 1;
+	readSlot = 2;
+	fresh = false;
+}
+
+void TripleBuffer::Publish(const olc::Pixel* source, const olc::DirtyRegion& changed, uint64_t tick)
+{
+	for (olc::DirtyRegion& region : stale)
+		region.Add(changed);
+
+	Frame& frame = frames[writeSlot];
+	olc::DirtyRegion& behind = stale[writeSlot];
+	behind.Clip(frameWidth, frameHeight);
+	for (const auto& r : behind.vRects)
+		for (int y = r.y0; y < r.y1; ++y)
+		{
+			const olc::Pixel* row = source + size_t(y) * frameWidth;
+			std::copy(row + r.x0, row + r.x1, frame.pixels.begin() + size_t(y) * frameWidth + r.x0);
+		}
+	behind.Clear();
+
+	frame.changed = pending;
+	frame.changed.Add(changed);
+	frame.changed.Clip(frameWidth, frameHeight);
+	frame.tick = tick;
+	pending.Clear();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	// The reader skipped the frame being replaced, so its changes still
+	// have to reach the reader
+	if (fresh)
+		frame.changed.Add(frames[readySlot].changed);
+	std::swap(writeSlot, readySlot);
+	fresh = true;
+}
+
+Frame* TripleBuffer::Acquire()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!fresh)
+		return nullptr;
+
+	std::swap(readSlot, readySlot);
+	fresh = false;
+	return &frames[readSlot];
+}